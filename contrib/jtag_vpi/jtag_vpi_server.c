@@ -0,0 +1,403 @@
+/*
+ * Reference server for the OpenOCD jtag_vpi driver
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+  Server side of the jtag_vpi protocol, both the classic fixed size
+  commands and the extended protocol. The JTAG pins are driven through
+  two hooks, tap_reset() and tap_clock(); in a VPI module they would set
+  the TCK/TMS/TDI nets and let the simulation advance, here they drive a
+  simulated TAP so the server can be used for testing without a simulator:
+
+	0x1  IDCODE, 32 bit, reads SIM_IDCODE
+	0x2  DATA, 32 bit scratch register, reads back what was written
+	other BYPASS
+
+  Classic protocol: every command is a struct vpi_cmd below, scans are
+  answered with the same struct carrying TDO in buffer_in.
+
+  Extended protocol: requested by a classic CMD_EXTENDED command with
+  "OCDX" in buffer_out and the client version in nb_bits; the server
+  answers with the same struct, "OCDX" in buffer_in and its own version
+  in nb_bits. From then on every command is an 8 byte header
+	u8 cmd, u8 flags, u8 0, u8 0, u32 nb_bits (little endian)
+  followed by (nb_bits + 7) / 8 bytes of TMS or TDI data, unless flags has
+  EXT_FLAG_TDI_ONES set (scans only, TDI all ones). Scans are answered with
+  (nb_bits + 7) / 8 bytes of TDO and nothing else. Clients send many
+  commands per write, so the server must not expect one command per read.
+
+  Version 2 adds batching of a whole JTAG queue: scans flagged
+  EXT_FLAG_DEFER append their TDO to a buffer instead of answering,
+  EXT_FLAG_NO_TDO scans don't answer at all, and CMD_FLUSH (no payload) is
+  answered with a u32 little endian byte count followed by all deferred
+  TDO, after which the buffer is empty. The client only uses this when the
+  server announced version 2 or later.
+
+  To compile run:
+  gcc -Wall -std=c99 -D_DEFAULT_SOURCE -o jtag_vpi_server jtag_vpi_server.c
+
+  Usage example:
+  ./jtag_vpi_server [port | unix:path] [classic]
+
+  openocd -c "interface jtag_vpi; jtag_vpi_set_unix_socket /tmp/vpi" \
+	  -c "jtag_vpi_set_extended on" \
+	  -c "jtag newtap sim tap -irlen 4 -expected-id 0x10db0001" -c init
+*/
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#define XFERT_MAX_SIZE		512
+
+#define CMD_RESET		0
+#define CMD_TMS_SEQ		1
+#define CMD_SCAN_CHAIN		2
+#define CMD_SCAN_CHAIN_FLIP_TMS	3
+#define CMD_STOP_SIMU		4
+#define CMD_EXTENDED		0x10
+#define CMD_FLUSH		0x11
+
+#define EXT_MAGIC		"OCDX"
+#define EXT_VERSION		2
+#define EXT_HEADER_SIZE		8
+#define EXT_FLAG_TDI_ONES	0x01
+#define EXT_FLAG_DEFER		0x02
+#define EXT_FLAG_NO_TDO		0x04
+
+struct vpi_cmd {
+	int cmd;
+	unsigned char buffer_out[XFERT_MAX_SIZE];
+	unsigned char buffer_in[XFERT_MAX_SIZE];
+	int length;
+	int nb_bits;
+};
+
+/* --- simulated TAP, replace these two hooks in a VPI module --- */
+
+#define SIM_IDCODE		0x10db0001
+#define SIM_IR_LEN		4
+#define SIM_IR_IDCODE	0x1
+#define SIM_IR_DATA		0x2
+
+enum tap_state {
+	TLR, RTI, SELDR, CAPDR, SHDR, EX1DR, PDR, EX2DR, UPDR,
+	SELIR, CAPIR, SHIR, EX1IR, PIR, EX2IR, UPIR
+};
+
+static const enum tap_state next_state[16][2] = {
+	[TLR] = { RTI, TLR },		[RTI] = { RTI, SELDR },
+	[SELDR] = { CAPDR, SELIR },	[CAPDR] = { SHDR, EX1DR },
+	[SHDR] = { SHDR, EX1DR },	[EX1DR] = { PDR, UPDR },
+	[PDR] = { PDR, EX2DR },		[EX2DR] = { SHDR, UPDR },
+	[UPDR] = { RTI, SELDR },	[SELIR] = { CAPIR, TLR },
+	[CAPIR] = { SHIR, EX1IR },	[SHIR] = { SHIR, EX1IR },
+	[EX1IR] = { PIR, UPIR },	[PIR] = { PIR, EX2IR },
+	[EX2IR] = { SHIR, UPIR },	[UPIR] = { RTI, SELDR },
+};
+
+static enum tap_state state = TLR;
+static uint32_t ir = SIM_IR_IDCODE;
+static uint32_t data_reg;
+static uint32_t shift_reg;
+static unsigned shift_len;
+
+static void tap_reset(void)
+{
+	state = TLR;
+	ir = SIM_IR_IDCODE;
+}
+
+/* one TCK cycle; returns TDO as seen before the rising edge */
+static int tap_clock(int tms, int tdi)
+{
+	int tdo = (state == SHDR || state == SHIR) ? shift_reg & 1 : 0;
+
+	switch (state) {
+	case TLR:
+		ir = SIM_IR_IDCODE;
+		break;
+	case CAPDR:
+		shift_len = (ir == SIM_IR_IDCODE || ir == SIM_IR_DATA) ? 32 : 1;
+		shift_reg = ir == SIM_IR_IDCODE ? SIM_IDCODE :
+			ir == SIM_IR_DATA ? data_reg : 0;
+		break;
+	case CAPIR:
+		shift_len = SIM_IR_LEN;
+		shift_reg = 0x1;
+		break;
+	case SHDR:
+	case SHIR:
+		shift_reg = (shift_reg >> 1) | ((uint32_t)tdi << (shift_len - 1));
+		break;
+	case UPDR:
+		if (ir == SIM_IR_DATA)
+			data_reg = shift_reg;
+		break;
+	case UPIR:
+		ir = shift_reg & ((1 << SIM_IR_LEN) - 1);
+		break;
+	default:
+		break;
+	}
+	state = next_state[state][tms];
+
+	return tdo;
+}
+
+/* --- protocol --- */
+
+static int read_all(int fd, void *buf, size_t len)
+{
+	uint8_t *p = buf;
+	while (len) {
+		ssize_t n = read(fd, p, len);
+		if (n <= 0)
+			return -1;
+		p += n;
+		len -= n;
+	}
+	return 0;
+}
+
+static int write_all(int fd, const void *buf, size_t len)
+{
+	const uint8_t *p = buf;
+	while (len) {
+		ssize_t n = write(fd, p, len);
+		if (n <= 0)
+			return -1;
+		p += n;
+		len -= n;
+	}
+	return 0;
+}
+
+static void tms_seq(const uint8_t *bits, uint32_t nb_bits)
+{
+	for (uint32_t i = 0; i < nb_bits; i++)
+		tap_clock((bits[i / 8] >> (i % 8)) & 1, 0);
+}
+
+/* shift nb_bits, TMS high on the last one for the FLIP_TMS variant */
+static void scan(const uint8_t *tdi, uint8_t *tdo, uint32_t nb_bits, int flip_tms)
+{
+	memset(tdo, 0, (nb_bits + 7) / 8);
+	for (uint32_t i = 0; i < nb_bits; i++) {
+		int tms = flip_tms && i == nb_bits - 1;
+		int bit = tdi ? (tdi[i / 8] >> (i % 8)) & 1 : 1;
+		if (tap_clock(tms, bit))
+			tdo[i / 8] |= 1 << (i % 8);
+	}
+}
+
+/* deferred TDO, version 2 */
+static uint8_t *deferred;
+static size_t deferred_len;
+static size_t deferred_size;
+
+static int defer_tdo(const uint8_t *tdo, size_t len)
+{
+	if (deferred_len + len > deferred_size) {
+		size_t size = deferred_size * 2 > deferred_len + len ?
+			deferred_size * 2 : deferred_len + len + 4096;
+		uint8_t *p = realloc(deferred, size);
+		if (!p)
+			return -1;
+		deferred = p;
+		deferred_size = size;
+	}
+	memcpy(deferred + deferred_len, tdo, len);
+	deferred_len += len;
+	return 0;
+}
+
+static int flush_tdo(int fd)
+{
+	uint8_t len[4] = {
+		deferred_len, deferred_len >> 8, deferred_len >> 16, deferred_len >> 24
+	};
+	if (write_all(fd, len, sizeof(len)) < 0 ||
+			write_all(fd, deferred, deferred_len) < 0)
+		return -1;
+	deferred_len = 0;
+	return 0;
+}
+
+static int serve_extended(int fd)
+{
+	uint8_t header[EXT_HEADER_SIZE];
+	uint8_t *data = NULL, *tdo = NULL;
+	size_t size = 0;
+
+	deferred_len = 0;
+
+	while (read_all(fd, header, sizeof(header)) == 0) {
+		uint32_t nb_bits = header[4] | header[5] << 8 | header[6] << 16 |
+			(uint32_t)header[7] << 24;
+		size_t nb_bytes = (nb_bits + 7) / 8;
+		int has_data = header[0] == CMD_TMS_SEQ ||
+			((header[0] == CMD_SCAN_CHAIN || header[0] == CMD_SCAN_CHAIN_FLIP_TMS) &&
+			 !(header[1] & EXT_FLAG_TDI_ONES));
+
+		if (nb_bytes > size) {
+			free(data);
+			free(tdo);
+			size = nb_bytes;
+			data = malloc(size);
+			tdo = malloc(size);
+			if (!data || !tdo)
+				return -1;
+		}
+		if (has_data && read_all(fd, data, nb_bytes) < 0)
+			break;
+
+		switch (header[0]) {
+		case CMD_RESET:
+			tap_reset();
+			break;
+		case CMD_TMS_SEQ:
+			tms_seq(data, nb_bits);
+			break;
+		case CMD_SCAN_CHAIN:
+		case CMD_SCAN_CHAIN_FLIP_TMS:
+			scan(has_data ? data : NULL, tdo, nb_bits,
+					header[0] == CMD_SCAN_CHAIN_FLIP_TMS);
+			if (header[1] & EXT_FLAG_NO_TDO)
+				break;
+			if (header[1] & EXT_FLAG_DEFER) {
+				if (defer_tdo(tdo, nb_bytes) < 0)
+					goto out;
+			} else if (write_all(fd, tdo, nb_bytes) < 0) {
+				goto out;
+			}
+			break;
+		case CMD_FLUSH:
+			if (flush_tdo(fd) < 0)
+				goto out;
+			break;
+		case CMD_STOP_SIMU:
+			free(data);
+			free(tdo);
+			exit(0);
+		default:
+			fprintf(stderr, "unknown extended command %d\n", header[0]);
+			goto out;
+		}
+	}
+out:
+	free(data);
+	free(tdo);
+	return 0;
+}
+
+static void serve(int fd, int allow_extended)
+{
+	struct vpi_cmd vpi;
+
+	while (read_all(fd, &vpi, sizeof(vpi)) == 0) {
+		switch (vpi.cmd) {
+		case CMD_RESET:
+			tap_reset();
+			break;
+		case CMD_TMS_SEQ:
+			tms_seq(vpi.buffer_out, vpi.nb_bits);
+			break;
+		case CMD_SCAN_CHAIN:
+		case CMD_SCAN_CHAIN_FLIP_TMS:
+			scan(vpi.buffer_out, vpi.buffer_in, vpi.nb_bits,
+					vpi.cmd == CMD_SCAN_CHAIN_FLIP_TMS);
+			if (write_all(fd, &vpi, sizeof(vpi)) < 0)
+				return;
+			break;
+		case CMD_STOP_SIMU:
+			exit(0);
+		case CMD_EXTENDED:
+			/* an old server would ignore this, as we do when asked to */
+			if (!allow_extended || memcmp(vpi.buffer_out, EXT_MAGIC, 4))
+				break;
+			memcpy(vpi.buffer_in, EXT_MAGIC, 4);
+			vpi.nb_bits = EXT_VERSION;
+			if (write_all(fd, &vpi, sizeof(vpi)) < 0)
+				return;
+			serve_extended(fd);
+			return;
+		default:
+			break;
+		}
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	const char *where = argc > 1 ? argv[1] : "5555";
+	int allow_extended = !(argc > 2 && !strcmp(argv[2], "classic"));
+	int server;
+
+	if (!strncmp(where, "unix:", 5)) {
+		struct sockaddr_un addr;
+		memset(&addr, 0, sizeof(addr));
+		addr.sun_family = AF_UNIX;
+		strncpy(addr.sun_path, where + 5, sizeof(addr.sun_path) - 1);
+		unlink(addr.sun_path);
+		server = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (server < 0 || bind(server, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+			perror("bind");
+			return 1;
+		}
+	} else {
+		struct sockaddr_in addr;
+		int one = 1;
+		memset(&addr, 0, sizeof(addr));
+		addr.sin_family = AF_INET;
+		addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		addr.sin_port = htons(atoi(where));
+		server = socket(AF_INET, SOCK_STREAM, 0);
+		if (server >= 0)
+			setsockopt(server, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+		if (server < 0 || bind(server, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+			perror("bind");
+			return 1;
+		}
+	}
+	if (listen(server, 1) < 0) {
+		perror("listen");
+		return 1;
+	}
+
+	fprintf(stderr, "jtag_vpi_server: listening on %s%s\n", where,
+			allow_extended ? "" : " (classic protocol only)");
+
+	while (1) {
+		int fd = accept(server, NULL, NULL);
+		if (fd < 0) {
+			perror("accept");
+			return 1;
+		}
+		tap_reset();
+		serve(fd, allow_extended);
+		close(fd);
+		fprintf(stderr, "jtag_vpi_server: connection closed\n");
+	}
+
+	return 0;
+}
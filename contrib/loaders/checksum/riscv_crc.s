@@ -0,0 +1,66 @@
+/***************************************************************************
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+/*
+	CRC32 (poly 0x04c11db7, MSB first, no final xor) of a memory block,
+	as computed by image_calculate_checksum(). RV32 only.
+
+	parameters:
+	a0 - address in - crc out
+	a1 - byte count
+	a2 - 1 KiB word aligned scratch area for the lookup table
+*/
+
+	.text
+	.option norvc
+
+_start:
+	/* table[i] = CRC of byte i, built on the target to save download time */
+	li	t2, 0x04c11db7
+	li	t0, 0
+	li	t5, 256
+	mv	t6, a2
+table_loop:
+	slli	t1, t0, 24
+	li	t3, 8
+table_bit:
+	slli	t4, t1, 1
+	bgez	t1, 1f
+	xor	t4, t4, t2
+1:	mv	t1, t4
+	addi	t3, t3, -1
+	bnez	t3, table_bit
+	sw	t1, 0(t6)
+	addi	t6, t6, 4
+	addi	t0, t0, 1
+	bne	t0, t5, table_loop
+
+	mv	t0, a0
+	li	a0, -1
+	add	a1, a1, t0
+	j	check
+byte_loop:
+	lbu	t1, 0(t0)
+	addi	t0, t0, 1
+	srli	t3, a0, 24
+	xor	t3, t3, t1
+	slli	t3, t3, 2
+	add	t3, t3, a2
+	lw	t3, 0(t3)
+	slli	a0, a0, 8
+	xor	a0, a0, t3
+check:
+	bne	t0, a1, byte_loop
+	ebreak
@@ -0,0 +1,59 @@
+/***************************************************************************
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+/*
+	Check that memory blocks hold nothing but the erased value. RV32 only.
+
+	parameters:
+	a0 - pointer to struct { uint32_t size_in_result_out, uint32_t addr }
+	     array, terminated by a zero size; sizes are in words
+	a1 - value to check
+*/
+
+	.text
+	.option norvc
+
+BLOCK_SIZE_RESULT	= 0
+BLOCK_ADDRESS		= 4
+SIZEOF_STRUCT_BLOCK	= 8
+
+_start:
+block_loop:
+	lw	t0, BLOCK_SIZE_RESULT(a0)	/* get size */
+	beqz	t0, done
+
+	lw	t1, BLOCK_ADDRESS(a0)		/* get address */
+
+word_loop:
+	lw	t2, 0(t1)			/* read word */
+	addi	t1, t1, 4
+
+	bne	t2, a1, not_erased
+
+	addi	t0, t0, -1
+	bnez	t0, word_loop
+
+	li	t2, 1				/* block is erased */
+save_result:
+	sw	t2, BLOCK_SIZE_RESULT(a0)
+	addi	a0, a0, SIZEOF_STRUCT_BLOCK
+	j	block_loop
+
+not_erased:
+	li	t2, 0
+	j	save_result
+
+done:
+	ebreak
@@ -0,0 +1,264 @@
+/***************************************************************************
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+/*
+  This is a stand-in remote bitbang server for testing the OpenOCD
+  remote_bitbang interface driver without hardware. It simulates a single
+  TAP and speaks both the classic character protocol and the extended
+  protocol with 'S' bulk shift commands (see
+  doc/manual/jtag/drivers/remote_bitbang.txt).
+
+  The TAP has a 4 bit IR with these instructions:
+	0x1  IDCODE, 32 bit, reads SIM_IDCODE
+	0x2  DATA, 32 bit scratch register, reads back what was written
+	other BYPASS
+
+  To compile run:
+  gcc -Wall -std=c99 -D_DEFAULT_SOURCE -o remote_bitbang_sim remote_bitbang_sim.c
+
+  Usage example:
+  ./remote_bitbang_sim 3335 [classic]
+
+  openocd -c "interface remote_bitbang; remote_bitbang_port 3335" \
+	  -c "jtag newtap sim tap -irlen 4 -expected-id 0x10db0001" \
+	  -c "init; irscan sim.tap 2; drscan sim.tap 32 0x12345678; drscan sim.tap 32 0"
+
+  Pass "classic" to make the server ignore the protocol probe, as an old
+  server would.
+*/
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#define SIM_IDCODE		0x10db0001
+#define SIM_IR_LEN		4
+#define SIM_IR_IDCODE	0x1
+#define SIM_IR_DATA		0x2
+#define SIM_IR_BYPASS	0xf
+
+enum tap_state {
+	TLR, RTI, SELDR, CAPDR, SHDR, EX1DR, PDR, EX2DR, UPDR,
+	SELIR, CAPIR, SHIR, EX1IR, PIR, EX2IR, UPIR
+};
+
+/* next state for TMS = 0 and TMS = 1 */
+static const enum tap_state next_state[16][2] = {
+	[TLR] = { RTI, TLR },		[RTI] = { RTI, SELDR },
+	[SELDR] = { CAPDR, SELIR },	[CAPDR] = { SHDR, EX1DR },
+	[SHDR] = { SHDR, EX1DR },	[EX1DR] = { PDR, UPDR },
+	[PDR] = { PDR, EX2DR },		[EX2DR] = { SHDR, UPDR },
+	[UPDR] = { RTI, SELDR },	[SELIR] = { CAPIR, TLR },
+	[CAPIR] = { SHIR, EX1IR },	[SHIR] = { SHIR, EX1IR },
+	[EX1IR] = { PIR, UPIR },	[PIR] = { PIR, EX2IR },
+	[EX2IR] = { SHIR, UPIR },	[UPIR] = { RTI, SELDR },
+};
+
+static enum tap_state state = TLR;
+static uint32_t ir = SIM_IR_IDCODE;
+static uint32_t data_reg;
+static uint32_t shift_reg;
+static unsigned shift_len;
+static int last_tck;
+
+static unsigned dr_len(void)
+{
+	return (ir == SIM_IR_IDCODE || ir == SIM_IR_DATA) ? 32 : 1;
+}
+
+/* advance the TAP on a rising edge of TCK */
+static void sim_clock(int tms, int tdi)
+{
+	switch (state) {
+	case TLR:
+		ir = SIM_IR_IDCODE;
+		break;
+	case CAPDR:
+		shift_len = dr_len();
+		shift_reg = ir == SIM_IR_IDCODE ? SIM_IDCODE :
+			ir == SIM_IR_DATA ? data_reg : 0;
+		break;
+	case CAPIR:
+		shift_len = SIM_IR_LEN;
+		shift_reg = 0x1;
+		break;
+	case SHDR:
+	case SHIR:
+		shift_reg = (shift_reg >> 1) | ((uint32_t)tdi << (shift_len - 1));
+		break;
+	case UPDR:
+		if (ir == SIM_IR_DATA)
+			data_reg = shift_reg;
+		break;
+	case UPIR:
+		ir = shift_reg & ((1 << SIM_IR_LEN) - 1);
+		break;
+	default:
+		break;
+	}
+	state = next_state[state][tms];
+}
+
+static void sim_write(int tck, int tms, int tdi)
+{
+	if (tck && !last_tck)
+		sim_clock(tms, tdi);
+	last_tck = tck;
+}
+
+static int sim_read(void)
+{
+	if (state == SHDR || state == SHIR)
+		return shift_reg & 1;
+	return 0;
+}
+
+static void sim_reset(int trst, int srst)
+{
+	(void)srst;
+	if (trst) {
+		state = TLR;
+		ir = SIM_IR_IDCODE;
+	}
+}
+
+/* 'S' <u32 le bit count> <flags> [tms bytes] [tdi bytes] */
+static int sim_shift(FILE *in, FILE *out)
+{
+	uint8_t hdr[5];
+	if (fread(hdr, 1, sizeof(hdr), in) != sizeof(hdr))
+		return -1;
+
+	uint32_t num_bits = hdr[0] | hdr[1] << 8 | hdr[2] << 16 | (uint32_t)hdr[3] << 24;
+	size_t num_bytes = (num_bits + 7) / 8;
+	uint8_t *tms = calloc(num_bytes ? num_bytes : 1, 1);
+	uint8_t *tdi = calloc(num_bytes ? num_bytes : 1, 1);
+	uint8_t *tdo = calloc(num_bytes ? num_bytes : 1, 1);
+	int ret = -1;
+
+	if (!tms || !tdi || !tdo)
+		goto out;
+	if ((hdr[4] & 0x02) && fread(tms, 1, num_bytes, in) != num_bytes)
+		goto out;
+	if ((hdr[4] & 0x04) && fread(tdi, 1, num_bytes, in) != num_bytes)
+		goto out;
+
+	int tms_bit = 0, tdi_bit = 0;
+	for (uint32_t i = 0; i < num_bits; i++) {
+		tms_bit = (tms[i / 8] >> (i % 8)) & 1;
+		tdi_bit = (tdi[i / 8] >> (i % 8)) & 1;
+		sim_write(0, tms_bit, tdi_bit);
+		if (sim_read())
+			tdo[i / 8] |= 1 << (i % 8);
+		sim_write(1, tms_bit, tdi_bit);
+	}
+	sim_write(0, tms_bit, tdi_bit);
+
+	ret = 0;
+	if ((hdr[4] & 0x01) && fwrite(tdo, 1, num_bytes, out) != num_bytes)
+		ret = -1;
+out:
+	free(tms);
+	free(tdi);
+	free(tdo);
+	return ret;
+}
+
+static void process_remote_protocol(FILE *in, FILE *out, int extended)
+{
+	int c;
+	while (1) {
+		c = getc(in);
+		if (c == EOF || c == 'Q') /* Quit */
+			break;
+		else if (c == 'b' || c == 'B') /* Blink */
+			continue;
+		else if (c >= 'r' && c <= 'r' + 3) { /* Reset */
+			char d = c - 'r';
+			sim_reset(!!(d & 2), (d & 1));
+		} else if (c >= '0' && c <= '0' + 7) { /* Write */
+			char d = c - '0';
+			sim_write(!!(d & 4), !!(d & 2), (d & 1));
+		} else if (c == 'R') {
+			putc('0' + sim_read(), out);
+			fflush(out);
+		} else if (c == 'V' && extended) {
+			fputs("V1", out);
+		} else if (c == 'S' && extended) {
+			if (sim_shift(in, out) < 0)
+				break;
+			fflush(out);
+		} else
+			fprintf(stderr, "Unknown command '%c' received\n", c);
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	int port = argc > 1 ? atoi(argv[1]) : 3335;
+	int extended = !(argc > 2 && !strcmp(argv[2], "classic"));
+
+	int server = socket(AF_INET, SOCK_STREAM, 0);
+	if (server < 0) {
+		perror("socket");
+		return 1;
+	}
+	int one = 1;
+	setsockopt(server, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+	struct sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = htons(port);
+	if (bind(server, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+			listen(server, 1) < 0) {
+		perror("bind/listen");
+		return 1;
+	}
+
+	fprintf(stderr, "remote_bitbang_sim: listening on port %d (%s protocol)\n",
+			port, extended ? "extended" : "classic");
+
+	while (1) {
+		int fd = accept(server, NULL, NULL);
+		if (fd < 0) {
+			perror("accept");
+			return 1;
+		}
+		FILE *in = fdopen(fd, "r");
+		FILE *out = fdopen(dup(fd), "w");
+		if (!in || !out) {
+			perror("fdopen");
+			return 1;
+		}
+
+		state = TLR;
+		ir = SIM_IR_IDCODE;
+		last_tck = 0;
+		process_remote_protocol(in, out, extended);
+
+		fclose(in);
+		fclose(out);
+		fprintf(stderr, "remote_bitbang_sim: connection closed\n");
+	}
+
+	return 0;
+}
@@ -779,13 +779,16 @@ int nand_read_page_raw(struct nand_device *nand, uint32_t page,
 	if (ERROR_OK != retval)
 		return retval;
 
-	if (data)
-		nand_read_data_page(nand, data, data_size);
+	if (data) {
+		retval = nand_read_data_page(nand, data, data_size);
+		if (ERROR_OK != retval)
+			return retval;
+	}
 
 	if (oob)
-		nand_read_data_page(nand, oob, oob_size);
+		retval = nand_read_data_page(nand, oob, oob_size);
 
-	return ERROR_OK;
+	return retval;
 }
 
 int nand_write_data_page(struct nand_device *nand, uint8_t *data, uint32_t size)
@@ -39,6 +39,10 @@ NAND_DEVICE_COMMAND_HANDLER(s3c2410_nand_device_command)
 	info->data = S3C2410_NFDATA;
 	info->nfstat = S3C2410_NFSTAT;
 
+	info->io.target = nand->target;
+	info->io.data = S3C2410_NFDATA;
+	info->io.op = ARM_NAND_NONE;
+
 	return ERROR_OK;
 }
 
@@ -79,6 +83,38 @@ static int s3c2410_read_data(struct nand_device *nand, void *data)
 	return ERROR_OK;
 }
 
+static int s3c2410_read_block_data(struct nand_device *nand,
+		uint8_t *data, int data_size)
+{
+	struct s3c24xx_nand_controller *s3c24xx_info = nand->controller_priv;
+	struct target *target = nand->target;
+
+	if (target->state != TARGET_HALTED) {
+		LOG_ERROR("target must be halted to use S3C24XX NAND flash controller");
+		return ERROR_NAND_OPERATION_FAILED;
+	}
+
+	/* NFDATA is byte wide here, so move whole pages with a hosted loop;
+	 * without a working area the core falls back to s3c2410_read_data() */
+	s3c24xx_info->io.chunk_size = nand->page_size;
+	return arm_nandread(&s3c24xx_info->io, data, data_size);
+}
+
+static int s3c2410_write_block_data(struct nand_device *nand,
+		uint8_t *data, int data_size)
+{
+	struct s3c24xx_nand_controller *s3c24xx_info = nand->controller_priv;
+	struct target *target = nand->target;
+
+	if (target->state != TARGET_HALTED) {
+		LOG_ERROR("target must be halted to use S3C24XX NAND flash controller");
+		return ERROR_NAND_OPERATION_FAILED;
+	}
+
+	s3c24xx_info->io.chunk_size = nand->page_size;
+	return arm_nandwrite(&s3c24xx_info->io, data, data_size);
+}
+
 static int s3c2410_nand_ready(struct nand_device *nand, int timeout)
 {
 	struct target *target = nand->target;
@@ -110,6 +146,8 @@ struct nand_flash_controller s3c2410_nand_controller = {
 	.address = &s3c24xx_address,
 	.write_data = &s3c2410_write_data,
 	.read_data = &s3c2410_read_data,
+	.write_block_data = &s3c2410_write_block_data,
+	.read_block_data = &s3c2410_read_block_data,
 	.write_page = s3c24xx_write_page,
 	.read_page = s3c24xx_read_page,
 	.nand_ready = &s3c2410_nand_ready,
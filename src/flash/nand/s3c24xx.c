@@ -33,7 +33,7 @@ S3C24XX_DEVICE_COMMAND()
 	*info = NULL;
 
 	struct s3c24xx_nand_controller *s3c24xx_info;
-	s3c24xx_info = malloc(sizeof(struct s3c24xx_nand_controller));
+	s3c24xx_info = calloc(1, sizeof(struct s3c24xx_nand_controller));
 	if (s3c24xx_info == NULL) {
 		LOG_ERROR("no memory for nand controller");
 		return -ENOMEM;
@@ -26,6 +26,7 @@
  */
 
 #include "imp.h"
+#include "arm_io.h"
 #include "s3c24xx_regs.h"
 #include <target/target.h>
 
@@ -35,6 +36,9 @@ struct s3c24xx_nand_controller {
 	uint32_t		 addr;
 	uint32_t		 data;
 	uint32_t		 nfstat;
+
+	/* hosted bulk data transfers, used by the s3c2410 */
+	struct arm_nand_data	 io;
 };
 
 /* Default to using the un-translated NAND register based address */
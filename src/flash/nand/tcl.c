@@ -240,6 +240,14 @@ COMMAND_HANDLER(handle_nand_check_bad_blocks_command)
 	return retval;
 }
 
+/* true if @a len bytes at @a buf (NULL meaning nothing) are all 0xff */
+static bool nand_buf_is_blank(const uint8_t *buf, uint32_t len)
+{
+	if (buf == NULL || len == 0)
+		return true;
+	return buf[0] == 0xff && memcmp(buf, buf + 1, len - 1) == 0;
+}
+
 COMMAND_HANDLER(handle_nand_write_command)
 {
 	struct nand_device *nand = NULL;
@@ -249,6 +257,12 @@ COMMAND_HANDLER(handle_nand_write_command)
 	if (ERROR_OK != retval)
 		return retval;
 
+	/* Programming all ones leaves a page as it is, so such pages need
+	 * not be sent at all. Not when the controller adds its own ECC to
+	 * the OOB: that would not be all ones. */
+	bool skip_blank = nand->use_raw || nand->controller->write_page == NULL;
+	uint32_t skipped = 0;
+
 	uint32_t total_bytes = s.size;
 	while (s.size > 0) {
 		int bytes_read = nand_fileio_read(nand, &s);
@@ -259,6 +273,13 @@ COMMAND_HANDLER(handle_nand_write_command)
 		}
 		s.size -= bytes_read;
 
+		if (skip_blank && nand_buf_is_blank(s.page, s.page_size)
+				&& nand_buf_is_blank(s.oob, s.oob_size)) {
+			skipped++;
+			s.address += s.page_size;
+			continue;
+		}
+
 		retval = nand_write_page(nand, s.address / nand->page_size,
 				s.page, s.page_size, s.oob, s.oob_size);
 		if (ERROR_OK != retval) {
@@ -273,9 +294,12 @@ COMMAND_HANDLER(handle_nand_write_command)
 
 	if (nand_fileio_finish(&s) == ERROR_OK) {
 		command_print(CMD_CTX, "wrote file %s to NAND flash %s up to "
-			"offset 0x%8.8" PRIx32 " in %fs (%0.3f KiB/s)",
+			"offset 0x%8.8" PRIx32 " in %fs (%0.3f MiB/s)",
 			CMD_ARGV[1], CMD_ARGV[0], s.address, duration_elapsed(&s.bench),
-			duration_kbps(&s.bench, total_bytes));
+			duration_kbps(&s.bench, total_bytes) / 1024);
+		if (skipped)
+			command_print(CMD_CTX, "%" PRIu32 " blank page(s) were left erased",
+				skipped);
 	}
 	return ERROR_OK;
 }
@@ -331,9 +355,9 @@ COMMAND_HANDLER(handle_nand_verify_command)
 
 	if (nand_fileio_finish(&file) == ERROR_OK) {
 		command_print(CMD_CTX, "verified file %s in NAND flash %s "
-			"up to offset 0x%8.8" PRIx32 " in %fs (%0.3f KiB/s)",
+			"up to offset 0x%8.8" PRIx32 " in %fs (%0.3f MiB/s)",
 			CMD_ARGV[1], CMD_ARGV[0], dev.address, duration_elapsed(&file.bench),
-			duration_kbps(&file.bench, dev.size));
+			duration_kbps(&file.bench, dev.size) / 1024);
 	}
 
 	return nand_fileio_cleanup(&dev);
@@ -360,10 +384,16 @@ COMMAND_HANDLER(handle_nand_dump_command)
 		}
 
 		if (NULL != s.page)
-			fileio_write(s.fileio, s.page_size, s.page, &size_written);
+			retval = fileio_write(s.fileio, s.page_size, s.page, &size_written);
 
-		if (NULL != s.oob)
-			fileio_write(s.fileio, s.oob_size, s.oob, &size_written);
+		if (ERROR_OK == retval && NULL != s.oob)
+			retval = fileio_write(s.fileio, s.oob_size, s.oob, &size_written);
+
+		if (ERROR_OK != retval) {
+			command_print(CMD_CTX, "error while writing file");
+			nand_fileio_cleanup(&s);
+			return retval;
+		}
 
 		s.size -= nand->page_size;
 		s.address += nand->page_size;
@@ -374,9 +404,9 @@ COMMAND_HANDLER(handle_nand_dump_command)
 		return retval;
 
 	if (nand_fileio_finish(&s) == ERROR_OK) {
-		command_print(CMD_CTX, "dumped %zu bytes in %fs (%0.3f KiB/s)",
+		command_print(CMD_CTX, "dumped %zu bytes in %fs (%0.3f MiB/s)",
 			filesize, duration_elapsed(&s.bench),
-			duration_kbps(&s.bench, filesize));
+			duration_kbps(&s.bench, filesize) / 1024);
 	}
 	return ERROR_OK;
 }
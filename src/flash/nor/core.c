@@ -27,6 +27,8 @@
 #include <flash/nor/core.h>
 #include <flash/nor/imp.h>
 #include <target/image.h>
+#include <target/memcache.h>
+#include <helper/time_support.h>
 
 /**
  * @file
@@ -37,10 +39,47 @@
 
 static struct flash_bank *flash_banks;
 
+/* true if no sector from @a first to @a last is known to be protected */
+static bool flash_range_unprotected(struct flash_bank *bank, int first, int last)
+{
+	struct flash_sector *blocks = bank->sectors;
+	int num_blocks = bank->num_sectors;
+
+	if (bank->num_prot_blocks) {
+		/* protection is per block here, and the range covers them all */
+		blocks = bank->prot_blocks;
+		num_blocks = bank->num_prot_blocks;
+		first = 0;
+		last = num_blocks - 1;
+	}
+
+	for (int i = first; i <= last && i < num_blocks; i++) {
+		if (blocks[i].is_protected == 1)
+			return false;
+	}
+	return true;
+}
+
 int flash_driver_erase(struct flash_bank *bank, int first, int last)
 {
 	int retval;
 
+	memcache_invalidate_range(bank->target, bank->base, bank->size);
+
+	/* one bank erase instead of many sector erases, where the driver
+	 * can do that and nothing needs to be left alone */
+	if (bank->driver->mass_erase && first == 0 && last == bank->num_sectors - 1
+			&& flash_range_unprotected(bank, first, last)) {
+		retval = bank->driver->mass_erase(bank);
+		if (retval == ERROR_OK) {
+			for (int i = first; i <= last; i++)
+				bank->sectors[i].is_erased = 1;
+			return ERROR_OK;
+		}
+		LOG_WARNING("mass erase of flash bank %d failed, erasing sector by sector",
+				bank->bank_number);
+	}
+
 	retval = bank->driver->erase(bank, first, last);
 	if (retval != ERROR_OK)
 		LOG_ERROR("failed erasing sectors %d to %d", first, last);
@@ -91,6 +130,8 @@ int flash_driver_write(struct flash_bank *bank,
 {
 	int retval;
 
+	memcache_invalidate_range(bank->target, bank->base + offset, count);
+
 	retval = bank->driver->write(bank, buffer, offset, count);
 	if (retval != ERROR_OK) {
 		LOG_ERROR(
@@ -295,12 +336,24 @@ int get_flash_bank_by_addr(struct target *target,
 	return ERROR_OK;
 }
 
-static int default_flash_mem_blank_check(struct flash_bank *bank)
+/* size of the host side read buffer used by the slow erase check */
+#define FLASH_MEM_BLANK_CHECK_CHUNK	(64 * 1024)
+
+/* true if all @a len bytes of @a buf equal @a value; the overlapping
+ * memcmp lets the C library do the wide compares */
+static bool flash_buf_is_filled(const uint8_t *buf, uint32_t len, uint8_t value)
+{
+	if (len == 0)
+		return true;
+	return buf[0] == value && memcmp(buf, buf + 1, len - 1) == 0;
+}
+
+/* Read sectors @a first .. num_sectors - 1 back to the host and check them
+ * against the erased value. Reads are large and may span several sectors;
+ * the rest of a sector is skipped as soon as it is known not to be erased. */
+static int default_flash_mem_blank_check(struct flash_bank *bank, int first)
 {
 	struct target *target = bank->target;
-	const int buffer_size = 1024;
-	int i;
-	uint32_t nBytes;
 	int retval = ERROR_OK;
 
 	if (bank->target->state != TARGET_HALTED) {
@@ -308,41 +361,102 @@ static int default_flash_mem_blank_check(struct flash_bank *bank)
 		return ERROR_TARGET_NOT_HALTED;
 	}
 
+	if (first >= bank->num_sectors)
+		return ERROR_OK;
+
+	const uint32_t buffer_size = FLASH_MEM_BLANK_CHECK_CHUNK;
+	uint32_t end = bank->sectors[bank->num_sectors - 1].offset
+			+ bank->sectors[bank->num_sectors - 1].size;
+
 	uint8_t *buffer = malloc(buffer_size);
+	if (buffer == NULL) {
+		LOG_ERROR("Out of memory");
+		return ERROR_FAIL;
+	}
 
-	for (i = 0; i < bank->num_sectors; i++) {
-		uint32_t j;
+	for (int i = first; i < bank->num_sectors; i++)
 		bank->sectors[i].is_erased = 1;
 
-		for (j = 0; j < bank->sectors[i].size; j += buffer_size) {
-			uint32_t chunk;
-			chunk = buffer_size;
-			if (chunk > (j - bank->sectors[i].size))
-				chunk = (j - bank->sectors[i].size);
-
-			retval = target_read_memory(target,
-					bank->base + bank->sectors[i].offset + j,
-					4,
-					chunk/4,
-					buffer);
-			if (retval != ERROR_OK)
-				goto done;
+	int i = first;
+	uint32_t offset = bank->sectors[first].offset;
+	while (i < bank->num_sectors) {
+		/* skip gaps between sectors and sectors already done */
+		if (offset < bank->sectors[i].offset)
+			offset = bank->sectors[i].offset;
+		if (offset >= bank->sectors[i].offset + bank->sectors[i].size) {
+			i++;
+			continue;
+		}
 
-			for (nBytes = 0; nBytes < chunk; nBytes++) {
-				if (buffer[nBytes] != bank->erased_value) {
-					bank->sectors[i].is_erased = 0;
-					break;
-				}
+		/* read as much as fits, not caring about sector boundaries */
+		uint32_t chunk_start = offset;
+		uint32_t chunk_end = offset + MIN(buffer_size, end - offset);
+		retval = target_read_buffer(target, bank->base + chunk_start,
+				chunk_end - chunk_start, buffer);
+		if (retval != ERROR_OK)
+			goto done;
+
+		while (i < bank->num_sectors && offset < chunk_end) {
+			struct flash_sector *sector = &bank->sectors[i];
+			uint32_t sector_end = sector->offset + sector->size;
+
+			if (offset < sector->offset)
+				offset = sector->offset;
+			if (offset >= chunk_end)
+				break;
+
+			uint32_t len = MIN(sector_end, chunk_end) - offset;
+			if (!flash_buf_is_filled(buffer + (offset - chunk_start), len,
+						bank->erased_value)) {
+				sector->is_erased = 0;
+				/* no need to read the rest of this sector */
+				offset = sector_end;
+			} else {
+				offset += len;
 			}
+
+			if (offset >= sector_end)
+				i++;
 		}
 	}
 
 done:
+	if (retval != ERROR_OK) {
+		/* erase state of the unchecked sectors is unknown */
+		for (; i < bank->num_sectors; i++)
+			bank->sectors[i].is_erased = -1;
+	}
 	free(buffer);
 
 	return retval;
 }
 
+int flash_wait_status(struct target *target, target_addr_t address,
+		uint32_t mask, uint32_t value, int timeout_ms, uint32_t *status)
+{
+	int64_t start = timeval_ms();
+	uint32_t val;
+
+	for (;;) {
+		int retval = target_read_u32(target, address, &val);
+		if (retval != ERROR_OK)
+			return retval;
+		if (status)
+			*status = val;
+		if ((val & mask) == value)
+			return ERROR_OK;
+
+		int64_t elapsed = timeval_ms() - start;
+		if (elapsed > timeout_ms)
+			return ERROR_TARGET_TIMEOUT;
+
+		/* back off to about eight reads per doubling of the wait,
+		 * which overshoots the end of the operation by at most 1/8 */
+		int64_t pause = MAX(1, MIN(elapsed / 8, 100));
+		alive_sleep(MIN(pause, timeout_ms - elapsed + 1));
+	}
+}
+
 int default_flash_blank_check(struct flash_bank *bank)
 {
 	struct target *target = bank->target;
@@ -357,7 +471,7 @@ int default_flash_blank_check(struct flash_bank *bank)
 	struct target_memory_check_block *block_array;
 	block_array = malloc(bank->num_sectors * sizeof(struct target_memory_check_block));
 	if (block_array == NULL)
-		return default_flash_mem_blank_check(bank);
+		return default_flash_mem_blank_check(bank, 0);
 
 	for (i = 0; i < bank->num_sectors; i++) {
 		block_array[i].address = bank->base + bank->sectors[i].offset;
@@ -365,28 +479,29 @@ int default_flash_blank_check(struct flash_bank *bank)
 		block_array[i].result = UINT32_MAX; /* erase state unknown */
 	}
 
-	bool fast_check = true;
 	for (i = 0; i < bank->num_sectors; ) {
 		retval = target_blank_check_memory(target,
 				block_array + i, bank->num_sectors - i,
 				bank->erased_value);
-		if (retval < 1) {
-			/* Run slow fallback if the first run gives no result
-			 * otherwise use possibly incomplete results */
-			if (i == 0)
-				fast_check = false;
+		if (retval < 1)
 			break;
-		}
 		i += retval; /* add number of blocks done this round */
 	}
 
-	if (fast_check) {
-		for (i = 0; i < bank->num_sectors; i++)
-			bank->sectors[i].is_erased = block_array[i].result;
-		retval = ERROR_OK;
+	int checked = i;
+	for (i = 0; i < checked; i++)
+		bank->sectors[i].is_erased = block_array[i].result;
+
+	if (checked < bank->num_sectors) {
+		/* Check whatever the target algorithm did not get to on the host */
+		if (checked == 0)
+			LOG_USER("Running slow fallback erase check - add working memory");
+		else
+			LOG_DEBUG("Checking sectors %d..%d on the host", checked,
+					bank->num_sectors - 1);
+		retval = default_flash_mem_blank_check(bank, checked);
 	} else {
-		LOG_USER("Running slow fallback erase check - add working memory");
-		retval = default_flash_mem_blank_check(bank);
+		retval = ERROR_OK;
 	}
 	free(block_array);
 
@@ -690,6 +805,45 @@ static bool flash_write_check_gap(struct flash_bank *bank,
 }
 
 
+/* what flash_write_unlock() did to one bank, for the throughput report */
+struct flash_write_bank_stats {
+	struct flash_bank *bank;
+	uint32_t bytes;
+	unsigned runs;
+	float erase_time;
+	float write_time;
+};
+
+static struct flash_write_bank_stats *flash_write_get_stats(
+		struct flash_write_bank_stats *stats, int num_stats,
+		struct flash_bank *bank)
+{
+	for (int i = 0; i < num_stats; i++) {
+		if (stats[i].bank == bank)
+			return &stats[i];
+	}
+	return NULL;
+}
+
+static void flash_write_report_stats(struct flash_write_bank_stats *stats,
+		int num_stats)
+{
+	/* the caller reports the total already, only split it up when the
+	 * image spanned several banks */
+	if (num_stats < 2)
+		return;
+
+	for (int i = 0; i < num_stats; i++) {
+		struct flash_write_bank_stats *st = &stats[i];
+		float kbps = st->write_time > 0 ? st->bytes / (1024.0 * st->write_time) : 0;
+
+		LOG_INFO("flash bank %d (%s): %" PRIu32 " bytes in %u run(s), "
+			"erase %fs, write %fs (%0.3f KiB/s)",
+			st->bank->bank_number, st->bank->name, st->bytes, st->runs,
+			st->erase_time, st->write_time, kbps);
+	}
+}
+
 int flash_write_unlock(struct target *target, struct image *image,
 	uint32_t *written, int erase, bool unlock)
 {
@@ -699,6 +853,8 @@ int flash_write_unlock(struct target *target, struct image *image,
 	uint32_t section_offset;
 	struct flash_bank *c;
 	int *padding;
+	struct flash_write_bank_stats *stats = NULL;
+	int num_stats = 0;
 
 	section = 0;
 	section_offset = 0;
@@ -913,6 +1069,23 @@ int flash_write_unlock(struct target *target, struct image *image,
 			}
 		}
 
+		struct flash_write_bank_stats *st = flash_write_get_stats(stats, num_stats, c);
+		if (st == NULL) {
+			st = realloc(stats, (num_stats + 1) * sizeof(*stats));
+			if (st == NULL) {
+				LOG_ERROR("Out of memory");
+				free(buffer);
+				retval = ERROR_FAIL;
+				goto done;
+			}
+			stats = st;
+			st = &stats[num_stats++];
+			memset(st, 0, sizeof(*st));
+			st->bank = c;
+		}
+
+		struct duration bench;
+		duration_start(&bench);
 		retval = ERROR_OK;
 
 		if (unlock)
@@ -925,9 +1098,18 @@ int flash_write_unlock(struct target *target, struct image *image,
 			}
 		}
 
+		if (duration_measure(&bench) == ERROR_OK)
+			st->erase_time += duration_elapsed(&bench);
+
 		if (retval == ERROR_OK) {
+			LOG_DEBUG("writing %" PRIu32 " bytes at " TARGET_ADDR_FMT
+				" to flash bank %d", run_size, run_address, c->bank_number);
+
 			/* write flash sectors */
+			duration_start(&bench);
 			retval = flash_driver_write(c, buffer, run_address - c->base, run_size);
+			if (duration_measure(&bench) == ERROR_OK)
+				st->write_time += duration_elapsed(&bench);
 		}
 
 		free(buffer);
@@ -939,9 +1121,14 @@ int flash_write_unlock(struct target *target, struct image *image,
 
 		if (written != NULL)
 			*written += run_size;	/* add run size to total written counter */
+		st->bytes += run_size;
+		st->runs++;
 	}
 
+	flash_write_report_stats(stats, num_stats);
+
 done:
+	free(stats);
 	free(sections);
 	free(padding);
 
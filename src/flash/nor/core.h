@@ -214,6 +214,18 @@ int default_flash_read(struct flash_bank *bank,
  * @returns ERROR_OK if successful; otherwise, an error code.
  */
 int default_flash_blank_check(struct flash_bank *bank);
+/**
+ * Polls the 32 bit flash status register at @a address until the bits
+ * in @a mask equal @a value.  The first read is immediate; after that
+ * the pause between reads grows with the time already waited, so
+ * short operations are noticed quickly while long ones (mass erase)
+ * do not flood the adapter with reads.
+ * @param status if not NULL, receives the last value read.
+ * @returns ERROR_OK if the condition was met, ERROR_TARGET_TIMEOUT if
+ * it was not within @a timeout_ms, or the error of a failed read.
+ */
+int flash_wait_status(struct target *target, target_addr_t address,
+		uint32_t mask, uint32_t value, int timeout_ms, uint32_t *status);
 
 /**
  * Returns the flash bank specified by @a name, which matches the
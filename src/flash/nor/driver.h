@@ -106,6 +106,19 @@ struct flash_driver {
 	 */
 	int (*erase)(struct flash_bank *bank, int first, int last);
 
+	/**
+	 * Whole bank erase routine (target-specific, optional).  When
+	 * an erase covers every sector of the bank, the flash core calls
+	 * this instead of flash_driver_s::erase, so the driver can use
+	 * a single chip or bank erase command rather than erasing sector
+	 * by sector.  If it fails, the core falls back to the sector
+	 * erase.
+	 *
+	 * @param bank The bank of flash to be erased.
+	 * @returns ERROR_OK if successful; otherwise, an error code.
+	 */
+	int (*mass_erase)(struct flash_bank *bank);
+
 	/**
 	 * Bank/sector protection routine (target-specific).
 	 *
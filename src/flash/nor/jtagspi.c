@@ -26,12 +26,22 @@
 
 #define JTAGSPI_MAX_TIMEOUT 3000
 
+/* pages queued per JTAG flush when writing */
+#define JTAGSPI_PIPELINE_PAGES 64
+/* status reads queued after each page program, to catch its completion */
+#define JTAGSPI_SPECULATIVE_POLLS 4
+/* bounds of the idle wait queued between a page program and its polls */
+#define JTAGSPI_PAGE_WAIT_MIN_US 50
+#define JTAGSPI_PAGE_WAIT_MAX_US 5000
+
 
 struct jtagspi_flash_bank {
 	struct jtag_tap *tap;
 	const struct flash_device *dev;
 	int probed;
 	uint32_t ir;
+	/* expected page program time, learned while writing */
+	unsigned page_wait_us;
 };
 
 FLASH_BANK_COMMAND_HANDLER(jtagspi_flash_bank_command)
@@ -50,6 +60,7 @@ FLASH_BANK_COMMAND_HANDLER(jtagspi_flash_bank_command)
 
 	info->tap = NULL;
 	info->probed = 0;
+	info->page_wait_us = 1000;
 	COMMAND_PARSE_NUMBER(u32, CMD_ARGV[6], info->ir);
 
 	return ERROR_OK;
@@ -75,24 +86,24 @@ static void flip_u8(uint8_t *in, uint8_t *out, int len)
 		out[i] = flip_u32(in[i], 8);
 }
 
-static int jtagspi_cmd(struct flash_bank *bank, uint8_t cmd,
-		uint32_t *addr, uint8_t *data, int len)
+/* Queue an SPI transaction. Data is sent from @a data_out (@a len bits)
+ * or, for reads, received into @a data_in still in JTAG bit order; it
+ * is only valid after the queue was executed and must be passed through
+ * flip_u8() by the caller. */
+static int jtagspi_queue_cmd(struct flash_bank *bank, uint8_t cmd,
+		uint32_t *addr, const uint8_t *data_out, uint8_t *data_in, int len)
 {
 	struct jtagspi_flash_bank *info = bank->driver_priv;
 	struct scan_field fields[6];
 	uint8_t marker = 1;
 	uint8_t xfer_bits_buf[4];
 	uint8_t addr_buf[3];
-	uint8_t *data_buf;
+	uint8_t *data_buf = NULL;
 	uint32_t xfer_bits;
-	int is_read, lenb, n;
+	int lenb, n;
 
 	/* LOG_DEBUG("cmd=0x%02x len=%i", cmd, len); */
 
-	is_read = (len < 0);
-	if (is_read)
-		len = -len;
-
 	n = 0;
 
 	fields[n].num_bits = 1;
@@ -127,22 +138,22 @@ static int jtagspi_cmd(struct flash_bank *bank, uint8_t cmd,
 	}
 
 	lenb = DIV_ROUND_UP(len, 8);
-	data_buf = malloc(lenb);
 	if (lenb > 0) {
-		if (data_buf == NULL) {
-			LOG_ERROR("no memory for spi buffer");
-			return ERROR_FAIL;
-		}
-		if (is_read) {
+		if (data_in) {
 			fields[n].num_bits = jtag_tap_count_enabled();
 			fields[n].out_value = NULL;
 			fields[n].in_value = NULL;
 			n++;
 
 			fields[n].out_value = NULL;
-			fields[n].in_value = data_buf;
+			fields[n].in_value = data_in;
 		} else {
-			flip_u8(data, data_buf, lenb);
+			data_buf = malloc(lenb);
+			if (data_buf == NULL) {
+				LOG_ERROR("no memory for spi buffer");
+				return ERROR_FAIL;
+			}
+			flip_u8((uint8_t *)data_out, data_buf, lenb);
 			fields[n].out_value = data_buf;
 			fields[n].in_value = NULL;
 		}
@@ -153,14 +164,35 @@ static int jtagspi_cmd(struct flash_bank *bank, uint8_t cmd,
 	jtagspi_set_ir(bank);
 	/* passing from an IR scan to SHIFT-DR clears BYPASS registers */
 	jtag_add_dr_scan(info->tap, n, fields, TAP_IDLE);
-	jtag_execute_queue();
 
-	if (is_read)
-		flip_u8(data_buf, data, lenb);
+	/* the scan has its own copy of what it sends */
 	free(data_buf);
 	return ERROR_OK;
 }
 
+static int jtagspi_cmd(struct flash_bank *bank, uint8_t cmd,
+		uint32_t *addr, uint8_t *data, int len)
+{
+	int is_read = (len < 0);
+	int retval;
+
+	if (is_read)
+		len = -len;
+
+	retval = jtagspi_queue_cmd(bank, cmd, addr, is_read ? NULL : data,
+			is_read ? data : NULL, len);
+	if (retval != ERROR_OK)
+		return retval;
+
+	retval = jtag_execute_queue();
+	if (retval != ERROR_OK)
+		return retval;
+
+	if (is_read)
+		flip_u8(data, data, DIV_ROUND_UP(len, 8));
+	return ERROR_OK;
+}
+
 static int jtagspi_probe(struct flash_bank *bank)
 {
 	struct jtagspi_flash_bank *info = bank->driver_priv;
@@ -221,13 +253,15 @@ static int jtagspi_probe(struct flash_bank *bank)
 	return ERROR_OK;
 }
 
-static void jtagspi_read_status(struct flash_bank *bank, uint32_t *status)
+static int jtagspi_read_status(struct flash_bank *bank, uint32_t *status)
 {
 	uint8_t buf;
-	if (jtagspi_cmd(bank, SPIFLASH_READ_STATUS, NULL, &buf, -8) == ERROR_OK) {
+	int retval = jtagspi_cmd(bank, SPIFLASH_READ_STATUS, NULL, &buf, -8);
+	if (retval == ERROR_OK) {
 		*status = buf;
 		/* LOG_DEBUG("status=0x%08" PRIx32, *status); */
 	}
+	return retval;
 }
 
 static int jtagspi_wait(struct flash_bank *bank, int timeout_ms)
@@ -238,7 +272,9 @@ static int jtagspi_wait(struct flash_bank *bank, int timeout_ms)
 
 	do {
 		dt = timeval_ms() - t0;
-		jtagspi_read_status(bank, &status);
+		int retval = jtagspi_read_status(bank, &status);
+		if (retval != ERROR_OK)
+			return retval;
 		if ((status & SPIFLASH_BSY_BIT) == 0) {
 			LOG_DEBUG("waited %" PRId64 " ms", dt);
 			return ERROR_OK;
@@ -254,8 +290,11 @@ static int jtagspi_write_enable(struct flash_bank *bank)
 {
 	uint32_t status;
 
-	jtagspi_cmd(bank, SPIFLASH_WRITE_ENABLE, NULL, NULL, 0);
-	jtagspi_read_status(bank, &status);
+	int retval = jtagspi_cmd(bank, SPIFLASH_WRITE_ENABLE, NULL, NULL, 0);
+	if (retval == ERROR_OK)
+		retval = jtagspi_read_status(bank, &status);
+	if (retval != ERROR_OK)
+		return retval;
 	if ((status & SPIFLASH_WE_BIT) == 0) {
 		LOG_ERROR("Cannot enable write to flash. Status=0x%08" PRIx32, status);
 		return ERROR_FAIL;
@@ -382,10 +421,104 @@ static int jtagspi_page_write(struct flash_bank *bank, const uint8_t *buffer, ui
 	return jtagspi_wait(bank, JTAGSPI_MAX_TIMEOUT);
 }
 
+/* Queue write enable, page program and the status reads for up to
+ * JTAGSPI_PIPELINE_PAGES pages, then run them with a single flush.
+ * Between a page program and its status reads the TAP idles for the
+ * expected program time. Returns the number of pages known to be
+ * written, fewer than queued if one was still busy after its last
+ * status read; the ones after it may have been ignored by the flash. */
+static int jtagspi_write_pages(struct flash_bank *bank, const uint8_t *buffer,
+		uint32_t offset, uint32_t count, int *pages_done)
+{
+	struct jtagspi_flash_bank *info = bank->driver_priv;
+	uint32_t pagesize = info->dev->pagesize;
+	int num_pages = MIN(DIV_ROUND_UP(count, pagesize), JTAGSPI_PIPELINE_PAGES);
+	/* per page: status after write enable, then the speculative polls */
+	const int stride = 1 + JTAGSPI_SPECULATIVE_POLLS;
+	int retval = ERROR_OK;
+	int khz;
+
+	*pages_done = 0;
+
+	if (jtag_get_speed_readable(&khz) != ERROR_OK || khz <= 0)
+		khz = 1000;	/* RCLK, assume something slow */
+	int wait_cycles = MAX(1, (int)((uint64_t)info->page_wait_us * khz / 1000));
+
+	uint8_t *status = malloc(num_pages * stride);
+	if (status == NULL) {
+		LOG_ERROR("no memory for status buffer");
+		return ERROR_FAIL;
+	}
+
+	for (int p = 0; p < num_pages && retval == ERROR_OK; p++) {
+		uint32_t page_offset = offset + p * pagesize;
+		uint8_t *st = status + p * stride;
+
+		retval = jtagspi_queue_cmd(bank, SPIFLASH_WRITE_ENABLE, NULL, NULL, NULL, 0);
+		if (retval == ERROR_OK)
+			retval = jtagspi_queue_cmd(bank, SPIFLASH_READ_STATUS, NULL, NULL, st, 8);
+		if (retval == ERROR_OK)
+			retval = jtagspi_queue_cmd(bank, SPIFLASH_PAGE_PROGRAM, &page_offset,
+					buffer + p * pagesize,
+					NULL, MIN(count - p * pagesize, pagesize) * 8);
+		if (retval != ERROR_OK)
+			break;
+		jtag_add_runtest(wait_cycles, TAP_IDLE);
+		for (int i = 1; i < stride && retval == ERROR_OK; i++)
+			retval = jtagspi_queue_cmd(bank, SPIFLASH_READ_STATUS, NULL, NULL, st + i, 8);
+	}
+
+	if (retval == ERROR_OK)
+		retval = jtag_execute_queue();
+	if (retval != ERROR_OK)
+		goto done;
+
+	flip_u8(status, status, num_pages * stride);
+
+	bool all_first = true;
+	for (int p = 0; p < num_pages; p++) {
+		uint8_t *st = status + p * stride;
+		int i;
+
+		if ((st[0] & SPIFLASH_WE_BIT) == 0) {
+			LOG_ERROR("Cannot enable write to flash. Status=0x%02" PRIx8, st[0]);
+			retval = ERROR_FAIL;
+			goto done;
+		}
+
+		for (i = 1; i < stride; i++) {
+			if ((st[i] & SPIFLASH_BSY_BIT) == 0)
+				break;
+		}
+		if (i > 1)
+			all_first = false;
+		if (i == stride) {
+			/* still busy: wait for it, and give the next pages more time */
+			info->page_wait_us = MIN(info->page_wait_us * 2, JTAGSPI_PAGE_WAIT_MAX_US);
+			LOG_DEBUG("page at 0x%08" PRIx32 " still busy, page wait now %u us",
+					offset + p * pagesize, info->page_wait_us);
+			retval = jtagspi_wait(bank, JTAGSPI_MAX_TIMEOUT);
+			if (retval == ERROR_OK)
+				*pages_done = p + 1;
+			goto done;
+		}
+	}
+
+	/* every page was done by the first poll: try waiting a bit less */
+	if (all_first)
+		info->page_wait_us = MAX(info->page_wait_us - info->page_wait_us / 8,
+				JTAGSPI_PAGE_WAIT_MIN_US);
+	*pages_done = num_pages;
+
+done:
+	free(status);
+	return retval;
+}
+
 static int jtagspi_write(struct flash_bank *bank, const uint8_t *buffer, uint32_t offset, uint32_t count)
 {
 	struct jtagspi_flash_bank *info = bank->driver_priv;
-	int retval;
+	uint32_t pagesize;
 	uint32_t n;
 
 	if (!(info->probed)) {
@@ -393,14 +526,30 @@ static int jtagspi_write(struct flash_bank *bank, const uint8_t *buffer, uint32_
 		return ERROR_FLASH_BANK_NOT_PROBED;
 	}
 
-	for (n = 0; n < count; n += info->dev->pagesize) {
-		retval = jtagspi_page_write(bank, buffer + n, offset + n,
-				MIN(count - n, info->dev->pagesize));
+	pagesize = info->dev->pagesize;
+
+	/* a write starting in the middle of a page takes that page on its own */
+	n = 0;
+	if (offset % pagesize) {
+		uint32_t head = MIN(count, pagesize - offset % pagesize);
+		int retval = jtagspi_page_write(bank, buffer, offset, head);
+		if (retval != ERROR_OK) {
+			LOG_ERROR("page write error");
+			return retval;
+		}
+		n = head;
+	}
+
+	while (n < count) {
+		int pages_done;
+		int retval = jtagspi_write_pages(bank, buffer + n, offset + n,
+				count - n, &pages_done);
 		if (retval != ERROR_OK) {
 			LOG_ERROR("page write error");
 			return retval;
 		}
-		LOG_DEBUG("wrote page at 0x%08" PRIx32, offset + n);
+		LOG_DEBUG("wrote %d page(s) at 0x%08" PRIx32, pages_done, offset + n);
+		n = MIN(count, n + pages_done * pagesize);
 	}
 	return ERROR_OK;
 }
@@ -100,10 +100,13 @@
 #define KEY1			0x45670123
 #define KEY2			0xCDEF89AB
 
-/* timeout values */
+/* timeout values, in ms. Half-word programming takes well under 1 ms and
+ * a page or option byte erase up to 40 ms, but some compatible parts are
+ * much slower, in particular for a mass erase of a large bank. */
 
-#define FLASH_WRITE_TIMEOUT 10
-#define FLASH_ERASE_TIMEOUT 100
+#define FLASH_WRITE_TIMEOUT 100
+#define FLASH_ERASE_TIMEOUT 1000
+#define FLASH_MASS_ERASE_TIMEOUT 10000
 
 struct stm32x_options {
 	uint16_t RDP;
@@ -157,12 +160,6 @@ static inline int stm32x_get_flash_reg(struct flash_bank *bank, uint32_t reg)
 	return reg + stm32x_info->register_base;
 }
 
-static inline int stm32x_get_flash_status(struct flash_bank *bank, uint32_t *status)
-{
-	struct target *target = bank->target;
-	return target_read_u32(target, stm32x_get_flash_reg(bank, STM32_FLASH_SR), status);
-}
-
 static int stm32x_wait_status_busy(struct flash_bank *bank, int timeout)
 {
 	struct target *target = bank->target;
@@ -170,19 +167,15 @@ static int stm32x_wait_status_busy(struct flash_bank *bank, int timeout)
 	int retval = ERROR_OK;
 
 	/* wait for busy to clear */
-	for (;;) {
-		retval = stm32x_get_flash_status(bank, &status);
-		if (retval != ERROR_OK)
-			return retval;
-		LOG_DEBUG("status: 0x%" PRIx32 "", status);
-		if ((status & FLASH_BSY) == 0)
-			break;
-		if (timeout-- <= 0) {
-			LOG_ERROR("timed out waiting for flash");
-			return ERROR_FAIL;
-		}
-		alive_sleep(1);
+	retval = flash_wait_status(target, stm32x_get_flash_reg(bank, STM32_FLASH_SR),
+			FLASH_BSY, 0, timeout, &status);
+	if (retval == ERROR_TARGET_TIMEOUT) {
+		LOG_ERROR("timed out waiting for flash");
+		return ERROR_FAIL;
 	}
+	if (retval != ERROR_OK)
+		return retval;
+	LOG_DEBUG("status: 0x%" PRIx32 "", status);
 
 	if (status & FLASH_WRPRTERR) {
 		LOG_ERROR("stm32x device protected");
@@ -427,9 +420,6 @@ static int stm32x_erase(struct flash_bank *bank, int first, int last)
 		return ERROR_TARGET_NOT_HALTED;
 	}
 
-	if ((first == 0) && (last == (bank->num_sectors - 1)))
-		return stm32x_mass_erase(bank);
-
 	/* unlock flash registers */
 	int retval = target_write_u32(target, stm32x_get_flash_reg(bank, STM32_FLASH_KEYR), KEY1);
 	if (retval != ERROR_OK)
@@ -717,7 +707,7 @@ static int stm32x_write(struct flash_bank *bank, const uint8_t *buffer,
 			if (retval != ERROR_OK)
 				goto reset_pg_and_lock;
 
-			retval = stm32x_wait_status_busy(bank, 5);
+			retval = stm32x_wait_status_busy(bank, FLASH_WRITE_TIMEOUT);
 			if (retval != ERROR_OK)
 				goto reset_pg_and_lock;
 
@@ -1511,7 +1501,7 @@ static int stm32x_mass_erase(struct flash_bank *bank)
 	if (retval != ERROR_OK)
 		return retval;
 
-	retval = stm32x_wait_status_busy(bank, FLASH_ERASE_TIMEOUT);
+	retval = stm32x_wait_status_busy(bank, FLASH_MASS_ERASE_TIMEOUT);
 	if (retval != ERROR_OK)
 		return retval;
 
@@ -1604,6 +1594,7 @@ struct flash_driver stm32f1x_flash = {
 	.commands = stm32x_command_handlers,
 	.flash_bank_command = stm32x_flash_bank_command,
 	.erase = stm32x_erase,
+	.mass_erase = stm32x_mass_erase,
 	.protect = stm32x_protect,
 	.write = stm32x_write,
 	.read = default_flash_read,
@@ -84,7 +84,7 @@ bool buf_cmp(const void *_buf1, const void *_buf2, unsigned size)
 
 	unsigned last = size / 8;
 	if (memcmp(_buf1, _buf2, last) != 0)
-		return false;
+		return true;
 
 	unsigned trailing = size % 8;
 	if (!trailing)
@@ -128,48 +128,68 @@ void *buf_set_ones(void *_buf, unsigned size)
 	return buf;
 }
 
+/* the @a n (1..8) bits of @a src starting at bit @a sq (0..7) */
+static inline uint8_t buf_get_bits8(const uint8_t *src, unsigned sq, unsigned n)
+{
+	unsigned v = src[0] >> sq;
+	if (sq + n > 8)
+		v |= src[1] << (8 - sq);
+	return v & ((1 << n) - 1);
+}
+
+/* replace the @a n (1..8) bits of @a dst starting at bit @a dq (0..7) */
+static inline void buf_put_bits8(uint8_t *dst, unsigned dq, unsigned n, uint8_t v)
+{
+	uint8_t mask = ((1 << n) - 1) << dq;
+	dst[0] = (dst[0] & ~mask) | ((v << dq) & mask);
+}
+
 void *buf_set_buf(const void *_src, unsigned src_start,
 	void *_dst, unsigned dst_start, unsigned len)
 {
 	const uint8_t *src = _src;
 	uint8_t *dst = _dst;
-	unsigned i, sb, db, sq, dq, lb, lq;
+	unsigned sq, dq, n;
 
-	sb = src_start / 8;
-	db = dst_start / 8;
+	src += src_start / 8;
+	dst += dst_start / 8;
 	sq = src_start % 8;
 	dq = dst_start % 8;
-	lb = len / 8;
-	lq = len % 8;
-
-	src += sb;
-	dst += db;
-
-	/* check if both buffers are on byte boundary and
-	 * len is a multiple of 8bit so we can simple copy
-	 * the buffer */
-	if ((sq == 0) && (dq == 0) &&  (lq == 0)) {
-		for (i = 0; i < lb; i++)
-			*dst++ = *src++;
+
+	if (len == 0)
 		return _dst;
+
+	/* bring the destination to a byte boundary */
+	if (dq) {
+		n = MIN(8 - dq, len);
+		buf_put_bits8(dst, dq, n, buf_get_bits8(src, sq, n));
+		dst++;
+		len -= n;
+		sq += n;
+		src += sq / 8;
+		sq %= 8;
 	}
 
-	/* fallback to slow bit copy */
-	for (i = 0; i < len; i++) {
-		if (((*src >> (sq&7)) & 1) == 1)
-			*dst |= 1 << (dq&7);
-		else
-			*dst &= ~(1 << (dq&7));
-		if (sq++ == 7) {
-			sq = 0;
-			src++;
-		}
-		if (dq++ == 7) {
-			dq = 0;
-			dst++;
+	if (sq == 0) {
+		/* both on byte boundaries: copy whole bytes */
+		memcpy(dst, src, len / 8);
+	} else {
+		/* each destination byte straddles two source bytes; do eight of
+		 * them at a time with a funnel shift over 64 bit words */
+		unsigned i = 0;
+		for (; i + 8 <= len / 8; i += 8) {
+			uint64_t w = le_to_h_u64(&src[i]) >> sq;
+			w |= (uint64_t)src[i + 8] << (64 - sq);
+			h_u64_to_le(&dst[i], w);
 		}
+		for (; i < len / 8; i++)
+			dst[i] = (src[i] >> sq) | (src[i + 1] << (8 - sq));
 	}
 
+	n = len % 8;
+	if (n)
+		buf_put_bits8(dst + len / 8, 0, n, buf_get_bits8(src + len / 8, sq, n));
+
 	return _dst;
 }
 
@@ -218,9 +238,24 @@ char *buf_to_str(const void *_buf, unsigned buf_len, unsigned radix)
 
 	unsigned str_len = ceil_f_to_u32(DIV_ROUND_UP(buf_len, 8) * factor);
 	char *str = calloc(str_len + 1, 1);
+	if (!str)
+		return NULL;
 
 	const uint8_t *buf = _buf;
 	int b256_len = DIV_ROUND_UP(buf_len, 8);
+
+	if (radix == 16) {
+		/* each byte is two digits, most significant byte first */
+		for (int i = 0; i < b256_len; i++) {
+			uint8_t tmp = buf[b256_len - 1 - i];
+			if (i == 0 && (buf_len % 8))
+				tmp &= 0xff >> (8 - (buf_len % 8));
+			str[2 * i] = "0123456789ABCDEF"[tmp >> 4];
+			str[2 * i + 1] = "0123456789ABCDEF"[tmp & 0x0f];
+		}
+		return str;
+	}
+
 	for (int i = b256_len - 1; i >= 0; i--) {
 		uint32_t tmp = buf[i];
 		if (((unsigned)i == (buf_len / 8)) && (buf_len % 8))
@@ -336,10 +371,42 @@ void bit_copy_queue_init(struct bit_copy_queue *q)
 	INIT_LIST_HEAD(&q->list);
 }
 
+/* true if @a qe, extended by @a bit_count bits, would read what it writes */
+static bool bit_copy_overlaps(const struct bit_copy_queue_entry *qe, unsigned bit_count)
+{
+	unsigned len = qe->bit_count + bit_count;
+	if (len == 0)
+		return false;
+
+	uintptr_t src_first = (uintptr_t)qe->src + qe->src_offset / 8;
+	uintptr_t src_last = (uintptr_t)qe->src + (qe->src_offset + len - 1) / 8;
+	uintptr_t dst_first = (uintptr_t)qe->dst + qe->dst_offset / 8;
+	uintptr_t dst_last = (uintptr_t)qe->dst + (qe->dst_offset + len - 1) / 8;
+
+	return src_first <= dst_last && dst_first <= src_last;
+}
+
 int bit_copy_queued(struct bit_copy_queue *q, uint8_t *dst, unsigned dst_offset, const uint8_t *src,
 	unsigned src_offset, unsigned bit_count)
 {
-	struct bit_copy_queue_entry *qe = malloc(sizeof(*qe));
+	struct bit_copy_queue_entry *qe;
+
+	/* a copy continuing the previous one in both buffers just extends it;
+	 * callers advance the buffer pointers rather than the offsets, so
+	 * compare bit positions */
+	if (!list_empty(&q->list)) {
+		qe = list_entry(q->list.prev, struct bit_copy_queue_entry, list);
+		unsigned dst_end = qe->dst_offset + qe->bit_count;
+		unsigned src_end = qe->src_offset + qe->bit_count;
+		if (qe->dst + dst_end / 8 == dst + dst_offset / 8 && dst_end % 8 == dst_offset % 8
+				&& qe->src + src_end / 8 == src + src_offset / 8 && src_end % 8 == src_offset % 8
+				&& !bit_copy_overlaps(qe, bit_count)) {
+			qe->bit_count += bit_count;
+			return ERROR_OK;
+		}
+	}
+
+	qe = malloc(sizeof(*qe));
 	if (!qe)
 		return ERROR_FAIL;
 
@@ -374,6 +441,54 @@ void bit_copy_discard(struct bit_copy_queue *q)
 	}
 }
 
+/* SWAR helpers, each byte lane of a uint64_t holding one character */
+#define LANES(b)	(0x0101010101010101ULL * (b))
+
+/* lanes of @a x holding an ASCII value in [lo, hi] get their bit 7 set */
+static inline uint64_t lanes_in_range(uint64_t x, uint8_t lo, uint8_t hi)
+{
+	/* bit 7 is dropped first so that no lane carries into the next one */
+	uint64_t x7 = x & LANES(0x7f);
+	uint64_t ge_lo = x7 + LANES(0x80 - lo);
+	uint64_t gt_hi = x7 + LANES(0x7f - hi);
+	return ge_lo & ~gt_hi & ~x & LANES(0x80);
+}
+
+/* convert 8 hex digits into 4 bytes; false if any of them is no hex digit */
+static inline bool unhexify_8(uint8_t *bin, const char *hex)
+{
+	uint64_t x = le_to_h_u64((const uint8_t *)hex);
+
+	uint64_t valid = lanes_in_range(x, '0', '9') | lanes_in_range(x | LANES(0x20), 'a', 'f');
+	if (valid != LANES(0x80))
+		return false;
+
+	/* '0'..'9' have bit 6 clear, letters set; 'A' & 0xf is 1, so add 9 */
+	uint64_t v = (x & LANES(0x0f)) + ((x >> 6) & LANES(0x01)) * 9;
+
+	/* lane 2k holds the high nibble of byte k, lane 2k + 1 the low one */
+	v = ((v << 4) | (v >> 8)) & 0x00ff00ff00ff00ffULL;
+	v = (v | (v >> 8)) & 0x0000ffff0000ffffULL;
+	v = v | (v >> 16);
+	h_u32_to_le(bin, (uint32_t)v);
+	return true;
+}
+
+/* convert 4 bytes into 8 lowercase hex digits */
+static inline void hexify_4(char *hex, const uint8_t *bin)
+{
+	uint64_t x = le_to_h_u32(bin);
+
+	/* spread byte k to lane 2k, then split it into both nibbles */
+	x = (x | (x << 16)) & 0x0000ffff0000ffffULL;
+	x = (x | (x << 8)) & 0x00ff00ff00ff00ffULL;
+	uint64_t n = ((x >> 4) & LANES(0x0f) & 0x00ff00ff00ff00ffULL) | ((x & LANES(0x0f)) << 8);
+
+	/* '0' + n, plus the gap up to 'a' for nibbles above 9 */
+	uint64_t above_9 = ((n + LANES(6)) >> 4) & LANES(0x01);
+	h_u64_to_le((uint8_t *)hex, n + LANES('0') + above_9 * ('a' - '0' - 10));
+}
+
 /**
  * Convert a string of hexadecimal pairs into its binary
  * representation.
@@ -388,7 +503,7 @@ void bit_copy_discard(struct bit_copy_queue *q)
  */
 size_t unhexify(uint8_t *bin, const char *hex, size_t count)
 {
-	size_t i;
+	size_t i, len;
 	char tmp;
 
 	if (!bin || !hex)
@@ -396,7 +511,16 @@ size_t unhexify(uint8_t *bin, const char *hex, size_t count)
 
 	memset(bin, 0, count);
 
-	for (i = 0; i < 2 * count; i++) {
+	/* callers may pass a count beyond the string, never load past its end */
+	len = strnlen(hex, 2 * count);
+
+	/* four pairs at a time, up to the first invalid digit */
+	for (i = 0; i + 8 <= len; i += 8) {
+		if (!unhexify_8(&bin[i / 2], &hex[i]))
+			break;
+	}
+
+	for (; i < 2 * count; i++) {
 		if (hex[i] >= 'a' && hex[i] <= 'f')
 			tmp = hex[i] - 'a' + 10;
 		else if (hex[i] >= 'A' && hex[i] <= 'F')
@@ -432,7 +556,10 @@ size_t hexify(char *hex, const uint8_t *bin, size_t count, size_t length)
 	if (!length)
 		return 0;
 
-	for (i = 0; i < length - 1 && i < 2 * count; i++) {
+	for (i = 0; i + 8 <= length - 1 && i + 8 <= 2 * count; i += 8)
+		hexify_4(&hex[i], &bin[i / 2]);
+
+	for (; i < length - 1 && i < 2 * count; i++) {
 		tmp = (bin[i / 2] >> (4 * ((i + 1) % 2))) & 0x0f;
 		hex[i] = hex_digits[tmp];
 	}
@@ -0,0 +1,168 @@
+/***************************************************************************
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+/*
+ * Randomized check of the bit copy helpers against a plain bit-by-bit
+ * copy, run by "make check".
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "log.h"
+#include "binarybuffer.h"
+
+#define BUF_SIZE	256
+#define ITERATIONS	200000
+
+static unsigned rand_below(unsigned n)
+{
+	return n ? (unsigned)rand() % n : 0;
+}
+
+static void fill_random(uint8_t *buf, unsigned size)
+{
+	for (unsigned i = 0; i < size; i++)
+		buf[i] = rand();
+}
+
+/* the reference, one bit at a time */
+static void ref_bit_copy(uint8_t *dst, unsigned dst_offset, const uint8_t *src,
+	unsigned src_offset, unsigned bit_count)
+{
+	for (unsigned i = 0; i < bit_count; i++) {
+		unsigned s = src_offset + i;
+		unsigned d = dst_offset + i;
+		if (src[s / 8] & (1 << (s % 8)))
+			dst[d / 8] |= 1 << (d % 8);
+		else
+			dst[d / 8] &= ~(1 << (d % 8));
+	}
+}
+
+static int report(const char *what, unsigned iteration, unsigned dst_offset,
+	unsigned src_offset, unsigned bit_count)
+{
+	fprintf(stderr, "%s mismatch in iteration %u: dst_offset %u, "
+		"src_offset %u, bit_count %u\n",
+		what, iteration, dst_offset, src_offset, bit_count);
+	return 1;
+}
+
+static int check_bit_copy(unsigned iteration)
+{
+	uint8_t src[BUF_SIZE], dst[BUF_SIZE], ref[BUF_SIZE];
+
+	unsigned bit_count = rand_below(BUF_SIZE * 8 / 2);
+	unsigned src_offset = rand_below(BUF_SIZE * 8 - bit_count);
+	unsigned dst_offset = rand_below(BUF_SIZE * 8 - bit_count);
+
+	fill_random(src, sizeof(src));
+	fill_random(dst, sizeof(dst));
+	memcpy(ref, dst, sizeof(ref));
+
+	bit_copy(dst, dst_offset, src, src_offset, bit_count);
+	ref_bit_copy(ref, dst_offset, src, src_offset, bit_count);
+
+	if (memcmp(dst, ref, sizeof(ref)))
+		return report("bit_copy", iteration, dst_offset, src_offset, bit_count);
+	return 0;
+}
+
+/* queue one transfer as a few pieces, the way adapter drivers split
+ * long scans, each piece addressed through an advanced buffer pointer */
+static int check_bit_copy_queue(unsigned iteration)
+{
+	uint8_t src[BUF_SIZE], dst[BUF_SIZE], ref[BUF_SIZE];
+	struct bit_copy_queue q;
+
+	unsigned bit_count = rand_below(BUF_SIZE * 8 / 2);
+	unsigned src_offset = rand_below(BUF_SIZE * 8 - bit_count);
+	unsigned dst_offset = rand_below(BUF_SIZE * 8 - bit_count);
+
+	fill_random(src, sizeof(src));
+	fill_random(dst, sizeof(dst));
+	memcpy(ref, dst, sizeof(ref));
+
+	bit_copy_queue_init(&q);
+	for (unsigned done = 0; done < bit_count; ) {
+		unsigned n = 1 + rand_below(bit_count - done);
+		unsigned s = src_offset + done;
+		unsigned d = dst_offset + done;
+		if (bit_copy_queued(&q, dst, d, src + s / 8, s % 8, n) != ERROR_OK) {
+			fprintf(stderr, "bit_copy_queued failed\n");
+			return 1;
+		}
+		done += n;
+	}
+	bit_copy_execute(&q);
+
+	ref_bit_copy(ref, dst_offset, src, src_offset, bit_count);
+
+	if (memcmp(dst, ref, sizeof(ref)))
+		return report("bit_copy_queue", iteration, dst_offset, src_offset, bit_count);
+	return 0;
+}
+
+/* pieces copied within one buffer must not be merged into a copy that
+ * reads bits an earlier piece already wrote */
+static int check_bit_copy_queue_overlap(unsigned iteration)
+{
+	uint8_t buf[BUF_SIZE], ref[BUF_SIZE];
+	struct bit_copy_queue q;
+
+	unsigned bit_count = rand_below(BUF_SIZE * 8 / 4);
+	unsigned src_offset = rand_below(BUF_SIZE * 8 / 2 - 8);
+	/* pieces are at most 8 bits, so none overlaps itself */
+	unsigned dst_offset = src_offset + 8 + rand_below(BUF_SIZE * 8 / 4);
+
+	fill_random(buf, sizeof(buf));
+	memcpy(ref, buf, sizeof(ref));
+
+	bit_copy_queue_init(&q);
+	for (unsigned done = 0; done < bit_count; ) {
+		unsigned n = 1 + rand_below(MIN(8u, bit_count - done));
+		if (bit_copy_queued(&q, buf, dst_offset + done,
+				buf, src_offset + done, n) != ERROR_OK) {
+			fprintf(stderr, "bit_copy_queued failed\n");
+			return 1;
+		}
+		ref_bit_copy(ref, dst_offset + done, ref, src_offset + done, n);
+		done += n;
+	}
+	bit_copy_execute(&q);
+
+	if (memcmp(buf, ref, sizeof(ref)))
+		return report("overlapping bit_copy_queue", iteration,
+			dst_offset, src_offset, bit_count);
+	return 0;
+}
+
+int main(void)
+{
+	srand(1);
+
+	for (unsigned i = 0; i < ITERATIONS; i++) {
+		if (check_bit_copy(i) || check_bit_copy_queue(i)
+				|| check_bit_copy_queue_overlap(i))
+			return 1;
+	}
+
+	return 0;
+}
@@ -714,6 +714,42 @@ int command_run_line(struct command_context *context, char *line)
 	return retval;
 }
 
+/**
+ * Like command_run_line(), but evaluates an already split command and
+ * leaves the result in the interpreter instead of echoing it to the log,
+ * so that binary results survive. Used by the binary Tcl server framing.
+ */
+int command_run_objv(struct command_context *context, int objc, Jim_Obj *const *objv)
+{
+	int retval = ERROR_FAIL;
+	int retcode;
+
+	context->current_target_override = NULL;
+
+	Jim_Interp *interp = context->interp;
+	Jim_DeleteAssocData(interp, "context");
+	retcode = Jim_SetAssocData(interp, "context", NULL, context);
+	if (retcode == JIM_OK) {
+		Jim_DeleteAssocData(interp, "retval");
+		retcode = Jim_SetAssocData(interp, "retval", NULL, &retval);
+		if (retcode == JIM_OK) {
+			retcode = Jim_EvalObjVector(interp, objc, objv);
+
+			Jim_DeleteAssocData(interp, "retval");
+		}
+		Jim_DeleteAssocData(interp, "context");
+	}
+	if (retcode == JIM_OK || retcode == JIM_EXIT)
+		return ERROR_OK;
+	if (retcode == ERROR_COMMAND_CLOSE_CONNECTION)
+		return retcode;
+
+	Jim_MakeErrorMessage(interp);
+	if (retval == ERROR_OK)
+		return ERROR_FAIL;
+	return retval;
+}
+
 int command_run_linef(struct command_context *context, const char *format, ...)
 {
 	int retval = ERROR_FAIL;
@@ -31,18 +31,34 @@
 #endif
 
 #include <jtag/jtag.h>
+#include <helper/time_support.h>
 #include "commands.h"
 
 struct cmd_queue_page {
 	struct cmd_queue_page *next;
 	void *address;
 	size_t used;
+	size_t size;
 };
 
 #define CMD_QUEUE_PAGE_SIZE (1024 * 1024)
 static struct cmd_queue_page *cmd_queue_pages;
 static struct cmd_queue_page *cmd_queue_pages_tail;
 
+/* Standard size pages are kept across queue resets instead of going back
+ * to malloc() after every flush. The pool is trimmed to the high-water
+ * mark of the last CMD_QUEUE_HWM_TIMEOUT_MS, never holds more than
+ * CMD_QUEUE_POOL_MAX pages and is dropped when an allocation fails. */
+#define CMD_QUEUE_POOL_MAX			8
+#define CMD_QUEUE_HWM_TIMEOUT_MS	10000
+static struct cmd_queue_page *cmd_queue_pool;
+static unsigned cmd_queue_pool_pages;
+static unsigned cmd_queue_hwm_pages;
+static int64_t cmd_queue_hwm_start;
+
+static unsigned cmd_queue_num_commands;
+static struct jtag_command_queue_stats cmd_queue_stats;
+
 struct jtag_command *jtag_command_queue;
 static struct jtag_command **next_command_pointer = &jtag_command_queue;
 
@@ -58,6 +74,57 @@ void jtag_queue_command(struct jtag_command *cmd)
 
 	/* store location where the next command pointer will be stored */
 	next_command_pointer = &cmd->next;
+
+	cmd_queue_num_commands++;
+}
+
+static void cmd_queue_pool_release(unsigned keep)
+{
+	while (cmd_queue_pool_pages > keep) {
+		struct cmd_queue_page *page = cmd_queue_pool;
+		cmd_queue_pool = page->next;
+		cmd_queue_pool_pages--;
+		free(page->address);
+		free(page);
+	}
+}
+
+static struct cmd_queue_page *cmd_queue_page_get(size_t size)
+{
+	struct cmd_queue_page *page;
+
+	if (size <= CMD_QUEUE_PAGE_SIZE && cmd_queue_pool) {
+		page = cmd_queue_pool;
+		cmd_queue_pool = page->next;
+		cmd_queue_pool_pages--;
+		cmd_queue_stats.page_reuses++;
+	} else {
+		size_t alloc_size = (size < CMD_QUEUE_PAGE_SIZE) ?
+					CMD_QUEUE_PAGE_SIZE : size;
+		page = malloc(sizeof(struct cmd_queue_page));
+		void *address = malloc(alloc_size);
+		if (!page || !address) {
+			/* memory pressure: give the pool back and retry once */
+			free(page);
+			free(address);
+			cmd_queue_pool_release(0);
+			page = malloc(sizeof(struct cmd_queue_page));
+			address = malloc(alloc_size);
+			if (!page || !address) {
+				LOG_ERROR("Out of memory for the JTAG command queue");
+				free(page);
+				free(address);
+				return NULL;
+			}
+		}
+		page->address = address;
+		page->size = alloc_size;
+		cmd_queue_stats.page_allocs++;
+	}
+
+	page->used = 0;
+	page->next = NULL;
+	return page;
 }
 
 void *cmd_queue_alloc(size_t size)
@@ -100,20 +167,19 @@ void *cmd_queue_alloc(size_t size)
 
 	if (*p_page) {
 		p_page = &cmd_queue_pages_tail;
-		if (CMD_QUEUE_PAGE_SIZE - (*p_page)->used < size)
+		if ((*p_page)->size - (*p_page)->used < size)
 			p_page = &((*p_page)->next);
 	}
 
 	if (!*p_page) {
-		*p_page = malloc(sizeof(struct cmd_queue_page));
-		(*p_page)->used = 0;
-		size_t alloc_size = (size < CMD_QUEUE_PAGE_SIZE) ?
-					CMD_QUEUE_PAGE_SIZE : size;
-		(*p_page)->address = malloc(alloc_size);
-		(*p_page)->next = NULL;
+		*p_page = cmd_queue_page_get(size);
+		if (!*p_page)
+			return NULL;
 		cmd_queue_pages_tail = *p_page;
 	}
 
+	cmd_queue_stats.bytes += size;
+
 	offset = (*p_page)->used;
 	(*p_page)->used += size;
 
@@ -124,26 +190,81 @@ void *cmd_queue_alloc(size_t size)
 static void cmd_queue_free(void)
 {
 	struct cmd_queue_page *page = cmd_queue_pages;
+	unsigned used_pages = 0;
 
 	while (page) {
 		struct cmd_queue_page *last = page;
-		free(page->address);
 		page = page->next;
-		free(last);
+		used_pages++;
+		if (last->size == CMD_QUEUE_PAGE_SIZE &&
+				cmd_queue_pool_pages < CMD_QUEUE_POOL_MAX) {
+			last->next = cmd_queue_pool;
+			cmd_queue_pool = last;
+			cmd_queue_pool_pages++;
+		} else {
+			free(last->address);
+			free(last);
+		}
 	}
 
 	cmd_queue_pages = NULL;
 	cmd_queue_pages_tail = NULL;
+
+	/* shrink the pool once a burst is over */
+	if (used_pages > cmd_queue_hwm_pages)
+		cmd_queue_hwm_pages = used_pages;
+	int64_t now = timeval_ms();
+	if (now - cmd_queue_hwm_start > CMD_QUEUE_HWM_TIMEOUT_MS) {
+		cmd_queue_pool_release(cmd_queue_hwm_pages);
+		cmd_queue_hwm_pages = used_pages;
+		cmd_queue_hwm_start = now;
+	}
 }
 
 void jtag_command_queue_reset(void)
 {
 	cmd_queue_free();
 
+	if (cmd_queue_stats.flushes == 0 && cmd_queue_stats.since == 0)
+		cmd_queue_stats.since = timeval_ms();
+	cmd_queue_stats.flushes++;
+	cmd_queue_stats.commands += cmd_queue_num_commands;
+	cmd_queue_stats.last_commands = cmd_queue_num_commands;
+	if (cmd_queue_num_commands > cmd_queue_stats.max_commands)
+		cmd_queue_stats.max_commands = cmd_queue_num_commands;
+	cmd_queue_stats.pool_pages = cmd_queue_pool_pages;
+	cmd_queue_num_commands = 0;
+
 	jtag_command_queue = NULL;
 	next_command_pointer = &jtag_command_queue;
 }
 
+const struct jtag_command_queue_stats *jtag_command_queue_get_stats(void)
+{
+	cmd_queue_stats.pool_pages = cmd_queue_pool_pages;
+	return &cmd_queue_stats;
+}
+
+void jtag_command_queue_count_ir_scan(bool elided)
+{
+	cmd_queue_stats.ir_scans++;
+	if (elided)
+		cmd_queue_stats.ir_scans_elided++;
+}
+
+void jtag_command_queue_count_dr_scan(unsigned bypass_bits)
+{
+	cmd_queue_stats.dr_scans++;
+	cmd_queue_stats.dr_bypass_bits += bypass_bits;
+}
+
+void jtag_command_queue_reset_stats(void)
+{
+	memset(&cmd_queue_stats, 0, sizeof(cmd_queue_stats));
+	cmd_queue_stats.pool_pages = cmd_queue_pool_pages;
+	cmd_queue_stats.since = timeval_ms();
+}
+
 /**
  * Copy a struct scan_field for insertion into the queue.
  *
@@ -183,16 +304,16 @@ int jtag_scan_size(const struct scan_command *cmd)
 	return bit_count;
 }
 
-int jtag_build_buffer(const struct scan_command *cmd, uint8_t **buffer)
+/* scratch buffer handed out by jtag_build_buffer_scratch(), grown as needed */
+static uint8_t *jtag_scratch_buffer;
+static size_t jtag_scratch_size;
+
+/* store the out_value of all fields in the zeroed @a buffer */
+static int jtag_fill_buffer(const struct scan_command *cmd, uint8_t *buffer)
 {
 	int bit_count = 0;
 	int i;
 
-	bit_count = jtag_scan_size(cmd);
-	*buffer = calloc(1, DIV_ROUND_UP(bit_count, 8));
-
-	bit_count = 0;
-
 	DEBUG_JTAG_IO("%s num_fields: %i",
 			cmd->ir_scan ? "IRSCAN" : "DRSCAN",
 			cmd->num_fields);
@@ -209,7 +330,7 @@ int jtag_build_buffer(const struct scan_command *cmd, uint8_t **buffer)
 					cmd->fields[i].num_bits, char_buf);
 			free(char_buf);
 #endif
-			buf_set_buf(cmd->fields[i].out_value, 0, *buffer,
+			buf_set_buf(cmd->fields[i].out_value, 0, buffer,
 					bit_count, cmd->fields[i].num_bits);
 		} else {
 			DEBUG_JTAG_IO("fields[%i].out_value[%i]: NULL",
@@ -224,6 +345,36 @@ int jtag_build_buffer(const struct scan_command *cmd, uint8_t **buffer)
 	return bit_count;
 }
 
+int jtag_build_buffer(const struct scan_command *cmd, uint8_t **buffer)
+{
+	*buffer = calloc(1, DIV_ROUND_UP(jtag_scan_size(cmd), 8));
+
+	return jtag_fill_buffer(cmd, *buffer);
+}
+
+int jtag_build_buffer_scratch(const struct scan_command *cmd, uint8_t **buffer)
+{
+	size_t size = DIV_ROUND_UP(jtag_scan_size(cmd), 8);
+
+	if (size > jtag_scratch_size) {
+		size_t new_size = MAX(size, 2 * jtag_scratch_size);
+		uint8_t *new_buffer = realloc(jtag_scratch_buffer, new_size);
+		if (!new_buffer) {
+			LOG_ERROR("out of memory for a %zu byte scan", size);
+			*buffer = NULL;
+			return 0;
+		}
+		jtag_scratch_buffer = new_buffer;
+		jtag_scratch_size = new_size;
+	}
+
+	/* fields without out_value shift zeros */
+	memset(jtag_scratch_buffer, 0, size);
+	*buffer = jtag_scratch_buffer;
+
+	return jtag_fill_buffer(cmd, *buffer);
+}
+
 int jtag_read_buffer(uint8_t *buffer, const struct scan_command *cmd)
 {
 	int i;
@@ -239,8 +390,12 @@ int jtag_read_buffer(uint8_t *buffer, const struct scan_command *cmd)
 		 */
 		if (cmd->fields[i].in_value) {
 			int num_bits = cmd->fields[i].num_bits;
-			uint8_t *captured = buf_set_buf(buffer, bit_count,
-					malloc(DIV_ROUND_UP(num_bits, 8)), 0, num_bits);
+			uint8_t *captured = cmd->fields[i].in_value;
+
+			/* straight into the field, with the bits past its end cleared */
+			buf_set_buf(buffer, bit_count, captured, 0, num_bits);
+			if (num_bits % 8)
+				captured[num_bits / 8] &= (1 << (num_bits % 8)) - 1;
 
 #ifdef _DEBUG_JTAG_IO_
 			char *char_buf = buf_to_str(captured,
@@ -252,11 +407,6 @@ int jtag_read_buffer(uint8_t *buffer, const struct scan_command *cmd)
 					i, num_bits, char_buf);
 			free(char_buf);
 #endif
-
-			if (cmd->fields[i].in_value)
-				buf_cpy(captured, cmd->fields[i].in_value, num_bits);
-
-			free(captured);
 		}
 		bit_count += cmd->fields[i].num_bits;
 	}
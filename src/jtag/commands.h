@@ -163,15 +163,43 @@ struct jtag_command {
 /** The current queue of jtag_command_s structures. */
 extern struct jtag_command *jtag_command_queue;
 
+/** Counters of the command queue, readable with 'jtag queue_stats'. */
+struct jtag_command_queue_stats {
+	uint64_t flushes;			/* queue resets, i.e. executed queues */
+	uint64_t commands;			/* commands queued over all flushes */
+	unsigned last_commands;		/* commands in the last flush */
+	unsigned max_commands;		/* most commands in one flush */
+	uint64_t bytes;				/* bytes handed out by cmd_queue_alloc() */
+	uint64_t page_allocs;		/* pages obtained from malloc() */
+	uint64_t page_reuses;		/* pages taken from the pool */
+	unsigned pool_pages;		/* pages currently kept in the pool */
+	uint64_t ir_scans;			/* IR scans requested by targets */
+	uint64_t ir_scans_elided;	/* of these, skipped by the IR cache */
+	uint64_t dr_scans;			/* DR scans queued for a TAP */
+	uint64_t dr_bypass_bits;	/* bypass bits padded around them */
+	int64_t since;				/* timeval_ms() of the last stats reset */
+};
+
 void *cmd_queue_alloc(size_t size);
 
 void jtag_queue_command(struct jtag_command *cmd);
 void jtag_command_queue_reset(void);
+const struct jtag_command_queue_stats *jtag_command_queue_get_stats(void);
+void jtag_command_queue_reset_stats(void);
+void jtag_command_queue_count_ir_scan(bool elided);
+void jtag_command_queue_count_dr_scan(unsigned bypass_bits);
 
 void jtag_scan_field_clone(struct scan_field *dst, const struct scan_field *src);
 enum scan_type jtag_scan_type(const struct scan_command *cmd);
 int jtag_scan_size(const struct scan_command *cmd);
 int jtag_read_buffer(uint8_t *buffer, const struct scan_command *cmd);
 int jtag_build_buffer(const struct scan_command *cmd, uint8_t **buffer);
+/**
+ * Like jtag_build_buffer(), but without an allocation per scan: the buffer
+ * is owned by the JTAG layer and reused by the next call. The caller must
+ * not free it and must be done with it, including jtag_read_buffer(),
+ * before building the next scan.
+ */
+int jtag_build_buffer_scratch(const struct scan_command *cmd, uint8_t **buffer);
 
 #endif /* OPENOCD_JTAG_COMMANDS_H */
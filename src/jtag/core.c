@@ -33,6 +33,7 @@
 #include "jtag.h"
 #include "swd.h"
 #include "interface.h"
+#include "commands.h"
 #include <transport/transport.h>
 #include <helper/jep106.h>
 
@@ -96,6 +97,13 @@ tap_state_t cmd_queue_cur_state = TAP_RESET;
 static bool jtag_verify_capture_ir = true;
 static int jtag_verify = 1;
 
+/* Skip IR scans that would load the instructions the TAPs already hold.
+ * jtag_ir_cache_valid says whether cur_instr and bypass of the enabled
+ * TAPs reflect the instruction registers, once the queue has executed.
+ */
+static bool jtag_ir_cache = true;
+static bool jtag_ir_cache_valid;
+
 /* how long the OpenOCD should wait before attempting JTAG communication after reset lines
  *deasserted (in ms) */
 static int adapter_nsrst_delay;	/* default to no nSRST delay */
@@ -352,13 +360,44 @@ static void jtag_prelude(tap_state_t state)
 	cmd_queue_cur_state = state;
 }
 
+/* true if an IR scan would only reload what the IR cache holds */
+static bool jtag_ir_scan_is_redundant(struct jtag_tap *active,
+	const struct scan_field *in_fields, tap_state_t state)
+{
+	/* the scan is still needed to capture, or to end in another state */
+	if (!jtag_ir_cache || !jtag_ir_cache_valid || in_fields->in_value
+			|| state != cmd_queue_cur_state)
+		return false;
+
+	for (struct jtag_tap *tap = jtag_tap_next_enabled(NULL); tap != NULL; tap = jtag_tap_next_enabled(tap)) {
+		if (tap == active) {
+			if (tap->bypass || buf_cmp(tap->cur_instr, in_fields->out_value, tap->ir_length))
+				return false;
+		} else if (!tap->bypass)
+			return false;
+	}
+	return true;
+}
+
+void jtag_ir_cache_invalidate(void)
+{
+	jtag_ir_cache_valid = false;
+}
+
 void jtag_add_ir_scan_noverify(struct jtag_tap *active, const struct scan_field *in_fields,
 	tap_state_t state)
 {
+	if (jtag_ir_scan_is_redundant(active, in_fields, state)) {
+		jtag_command_queue_count_ir_scan(true);
+		return;
+	}
+
 	jtag_prelude(state);
 
 	int retval = interface_jtag_add_ir_scan(active, in_fields, state);
 	jtag_set_error(retval);
+	jtag_ir_cache_valid = retval == ERROR_OK;
+	jtag_command_queue_count_ir_scan(false);
 }
 
 static void jtag_add_ir_scan_noverify_callback(struct jtag_tap *active,
@@ -395,6 +434,7 @@ void jtag_add_plain_ir_scan(int num_bits, const uint8_t *out_bits, uint8_t *in_b
 	assert(state != TAP_RESET);
 
 	jtag_prelude(state);
+	jtag_ir_cache_invalidate();
 
 	int retval = interface_jtag_add_plain_ir_scan(
 			num_bits, out_bits, in_bits, state);
@@ -508,6 +548,7 @@ int jtag_add_tms_seq(unsigned nbits, const uint8_t *seq, enum tap_state state)
 
 	jtag_checks();
 	cmd_queue_cur_state = state;
+	jtag_ir_cache_invalidate();
 
 	retval = interface_add_tms_seq(nbits, seq, state);
 	jtag_set_error(retval);
@@ -544,6 +585,9 @@ void jtag_add_pathmove(int num_states, const tap_state_t *path)
 
 	jtag_checks();
 
+	/* the path may shift through IRSHIFT */
+	jtag_ir_cache_invalidate();
+
 	jtag_set_error(interface_jtag_add_pathmove(num_states, path));
 	cmd_queue_cur_state = path[num_states - 1];
 }
@@ -842,7 +886,12 @@ int default_interface_jtag_execute_queue(void)
 void jtag_execute_queue_noclear(void)
 {
 	jtag_flush_queue_count++;
-	jtag_set_error(interface_jtag_execute_queue());
+	int retval = interface_jtag_execute_queue();
+	jtag_set_error(retval);
+
+	/* the instructions may not have made it into the TAPs */
+	if (retval != ERROR_OK)
+		jtag_ir_cache_invalidate();
 
 	if (jtag_flush_queue_sleep > 0) {
 		/* For debug purposes it can be useful to test performance
@@ -874,6 +923,7 @@ static int jtag_reset_callback(enum jtag_event event, void *priv)
 		/* current instruction is either BYPASS or IDCODE */
 		buf_set_ones(tap->cur_instr, tap->ir_length);
 		tap->bypass = 1;
+		jtag_ir_cache_invalidate();
 	}
 
 	return ERROR_OK;
@@ -1704,6 +1754,17 @@ bool jtag_will_verify_capture_ir()
 	return jtag_verify_capture_ir;
 }
 
+void jtag_set_ir_cache(bool enable)
+{
+	jtag_ir_cache = enable;
+	jtag_ir_cache_invalidate();
+}
+
+bool jtag_will_cache_ir(void)
+{
+	return jtag_ir_cache;
+}
+
 int jtag_power_dropout(int *dropout)
 {
 	if (jtag == NULL) {
@@ -51,6 +51,8 @@ static volatile uint32_t *pio_base;
 
 static bb_value_t bcm2835gpio_read(void);
 static int bcm2835gpio_write(int tck, int tms, int tdi);
+static int bcm2835gpio_shift(const uint8_t *tms, const uint8_t *tdi,
+		uint8_t *tdo, unsigned num_bits);
 static int bcm2835gpio_reset(int trst, int srst);
 
 static int bcm2835_swdio_read(void);
@@ -62,6 +64,7 @@ static int bcm2835gpio_quit(void);
 static struct bitbang_interface bcm2835gpio_bitbang = {
 	.read = bcm2835gpio_read,
 	.write = bcm2835gpio_write,
+	.shift = bcm2835gpio_shift,
 	.reset = bcm2835gpio_reset,
 	.swdio_read = bcm2835_swdio_read,
 	.swdio_drive = bcm2835_swdio_drive,
@@ -110,6 +113,55 @@ static int bcm2835gpio_write(int tck, int tms, int tdi)
 	return ERROR_OK;
 }
 
+/* JTAG bulk shift, same GPIO sequence as write() and read() per bit
+ * without going through the bitbang callbacks */
+static int bcm2835gpio_shift(const uint8_t *tms, const uint8_t *tdi,
+		uint8_t *tdo, unsigned num_bits)
+{
+	uint32_t tck_mask = 1 << tck_gpio;
+	uint32_t tms_mask = 1 << tms_gpio;
+	uint32_t tdi_mask = 1 << tdi_gpio;
+	uint32_t tdo_mask = 1 << tdo_gpio;
+
+	for (unsigned i = 0; i < num_bits; i++) {
+		unsigned bytec = i / 8;
+		uint8_t bcval = 1 << (i % 8);
+		uint32_t set = 0;
+		uint32_t clear = tck_mask;
+
+		if (tms && (tms[bytec] & bcval))
+			set |= tms_mask;
+		else
+			clear |= tms_mask;
+		if (tdi && (tdi[bytec] & bcval))
+			set |= tdi_mask;
+		else
+			clear |= tdi_mask;
+
+		GPIO_SET = set;
+		GPIO_CLR = clear;
+		for (unsigned int j = 0; j < jtag_delay; j++)
+			asm volatile ("");
+
+		if (tdo) {
+			if (GPIO_LEV & tdo_mask)
+				tdo[bytec] |= bcval;
+			else
+				tdo[bytec] &= ~bcval;
+		}
+
+		GPIO_SET = tck_mask;
+		for (unsigned int j = 0; j < jtag_delay; j++)
+			asm volatile ("");
+	}
+
+	GPIO_CLR = tck_mask;
+	for (unsigned int j = 0; j < jtag_delay; j++)
+		asm volatile ("");
+
+	return ERROR_OK;
+}
+
 static int bcm2835gpio_swd_write(int tck, int tms, int tdi)
 {
 	uint32_t set = tck<<swclk_gpio | tdi<<swdio_gpio;
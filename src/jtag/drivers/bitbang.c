@@ -67,6 +67,77 @@ struct bitbang_interface *bitbang_interface;
  */
 #define CLOCK_IDLE() 0
 
+/**
+ * Clock out @a num_bits bits with TCK ending low, see
+ * bitbang_interface::shift. Adapters without a bulk shift get two write()
+ * calls and a read() or sample() per bit.
+ */
+static int bitbang_shift(const uint8_t *tms, const uint8_t *tdi, uint8_t *tdo,
+		unsigned num_bits)
+{
+	if (num_bits == 0)
+		return ERROR_OK;
+
+	if (bitbang_interface->shift)
+		return bitbang_interface->shift(tms, tdi, tdo, num_bits);
+
+	size_t buffered = 0;
+	int tms_bit = 0;
+	int tdi_bit = 0;
+	for (unsigned i = 0; i < num_bits; i++) {
+		unsigned bytec = i / 8;
+		uint8_t bcval = 1 << (i % 8);
+
+		tms_bit = tms && (tms[bytec] & bcval);
+		tdi_bit = tdi && (tdi[bytec] & bcval);
+
+		if (bitbang_interface->write(0, tms_bit, tdi_bit) != ERROR_OK)
+			return ERROR_FAIL;
+
+		if (tdo) {
+			if (bitbang_interface->buf_size) {
+				if (bitbang_interface->sample() != ERROR_OK)
+					return ERROR_FAIL;
+				buffered++;
+			} else {
+				switch (bitbang_interface->read()) {
+					case BB_LOW:
+						tdo[bytec] &= ~bcval;
+						break;
+					case BB_HIGH:
+						tdo[bytec] |= bcval;
+						break;
+					default:
+						return ERROR_FAIL;
+				}
+			}
+		}
+
+		if (bitbang_interface->write(1, tms_bit, tdi_bit) != ERROR_OK)
+			return ERROR_FAIL;
+
+		if (tdo && bitbang_interface->buf_size &&
+				(buffered == bitbang_interface->buf_size ||
+				 i == num_bits - 1)) {
+			for (unsigned j = i + 1 - buffered; j <= i; j++) {
+				switch (bitbang_interface->read_sample()) {
+					case BB_LOW:
+						tdo[j/8] &= ~(1 << (j % 8));
+						break;
+					case BB_HIGH:
+						tdo[j/8] |= 1 << (j % 8);
+						break;
+					default:
+						return ERROR_FAIL;
+				}
+			}
+			buffered = 0;
+		}
+	}
+
+	return bitbang_interface->write(CLOCK_IDLE(), tms_bit, tdi_bit);
+}
+
 /* The bitbang driver leaves the TCK 0 when in idle */
 static void bitbang_end_state(tap_state_t state)
 {
@@ -76,19 +147,16 @@ static void bitbang_end_state(tap_state_t state)
 
 static int bitbang_state_move(int skip)
 {
-	int i = 0, tms = 0;
-	uint8_t tms_scan = tap_get_tms_path(tap_get_state(), tap_get_end_state());
-	int tms_count = tap_get_tms_path_len(tap_get_state(), tap_get_end_state());
+	uint8_t tms_scan;
+	unsigned tms_count = tap_append_tms_path(&tms_scan, 0,
+			tap_get_state(), tap_get_end_state(), skip);
 
-	for (i = skip; i < tms_count; i++) {
-		tms = (tms_scan >> i) & 1;
-		if (bitbang_interface->write(0, tms, 0) != ERROR_OK)
-			return ERROR_FAIL;
-		if (bitbang_interface->write(1, tms, 0) != ERROR_OK)
+	if (tms_count > 0) {
+		if (bitbang_shift(&tms_scan, NULL, NULL, tms_count) != ERROR_OK)
 			return ERROR_FAIL;
-	}
-	if (bitbang_interface->write(CLOCK_IDLE(), tms, 0) != ERROR_OK)
+	} else if (bitbang_interface->write(CLOCK_IDLE(), 0, 0) != ERROR_OK) {
 		return ERROR_FAIL;
+	}
 
 	tap_set_state(tap_get_end_state());
 	return ERROR_OK;
@@ -105,18 +173,7 @@ static int bitbang_execute_tms(struct jtag_command *cmd)
 
 	DEBUG_JTAG_IO("TMS: %d bits", num_bits);
 
-	int tms = 0;
-	for (unsigned i = 0; i < num_bits; i++) {
-		tms = ((bits[i/8] >> (i % 8)) & 1);
-		if (bitbang_interface->write(0, tms, 0) != ERROR_OK)
-			return ERROR_FAIL;
-		if (bitbang_interface->write(1, tms, 0) != ERROR_OK)
-			return ERROR_FAIL;
-	}
-	if (bitbang_interface->write(CLOCK_IDLE(), tms, 0) != ERROR_OK)
-		return ERROR_FAIL;
-
-	return ERROR_OK;
+	return bitbang_shift(bits, NULL, NULL, num_bits);
 }
 
 static int bitbang_path_move(struct pathmove_command *cmd)
@@ -155,12 +212,24 @@ static int bitbang_path_move(struct pathmove_command *cmd)
 	return ERROR_OK;
 }
 
+/* runtests up to this length go out as one precomputed TMS sequence */
+#define BITBANG_RUNTEST_MAX_CYCLES	64
+
 static int bitbang_runtest(int num_cycles)
 {
-	int i;
-
 	tap_state_t saved_end_state = tap_get_end_state();
 
+	if (num_cycles <= BITBANG_RUNTEST_MAX_CYCLES) {
+		uint8_t tms[TAP_TMS_RUNTEST_BYTES(BITBANG_RUNTEST_MAX_CYCLES)];
+		unsigned tms_count = tap_append_tms_runtest(tms, 0, tap_get_state(), 0,
+				num_cycles, saved_end_state);
+
+		if (bitbang_shift(tms, NULL, NULL, tms_count) != ERROR_OK)
+			return ERROR_FAIL;
+		tap_set_state(saved_end_state);
+		return ERROR_OK;
+	}
+
 	/* only do a state_move when we're not already in IDLE */
 	if (tap_get_state() != TAP_IDLE) {
 		bitbang_end_state(TAP_IDLE);
@@ -169,13 +238,7 @@ static int bitbang_runtest(int num_cycles)
 	}
 
 	/* execute num_cycles */
-	for (i = 0; i < num_cycles; i++) {
-		if (bitbang_interface->write(0, 0, 0) != ERROR_OK)
-			return ERROR_FAIL;
-		if (bitbang_interface->write(1, 0, 0) != ERROR_OK)
-			return ERROR_FAIL;
-	}
-	if (bitbang_interface->write(CLOCK_IDLE(), 0, 0) != ERROR_OK)
+	if (bitbang_shift(NULL, NULL, NULL, num_cycles) != ERROR_OK)
 		return ERROR_FAIL;
 
 	/* finish in end_state */
@@ -207,7 +270,6 @@ static int bitbang_scan(bool ir_scan, enum scan_type type, uint8_t *buffer,
 		unsigned scan_size)
 {
 	tap_state_t saved_end_state = tap_get_end_state();
-	unsigned bit_cnt;
 
 	if (!((!ir_scan &&
 			(tap_get_state() == TAP_DRSHIFT)) ||
@@ -222,70 +284,46 @@ static int bitbang_scan(bool ir_scan, enum scan_type type, uint8_t *buffer,
 		bitbang_end_state(saved_end_state);
 	}
 
-	size_t buffered = 0;
-	for (bit_cnt = 0; bit_cnt < scan_size; bit_cnt++) {
-		int tms = (bit_cnt == scan_size-1) ? 1 : 0;
-		int tdi;
-		int bytec = bit_cnt/8;
-		int bcval = 1 << (bit_cnt % 8);
-
-		/* if we're just reading the scan, but don't care about the output
-		 * default to outputting 'low', this also makes valgrind traces more readable,
-		 * as it removes the dependency on an uninitialised value
-		 */
-		tdi = 0;
-		if ((type != SCAN_IN) && (buffer[bytec] & bcval))
-			tdi = 1;
-
-		if (bitbang_interface->write(0, tms, tdi) != ERROR_OK)
-			return ERROR_FAIL;
+	/* if we're just reading the scan, but don't care about the output
+	 * default to outputting 'low', this also makes valgrind traces more readable,
+	 * as it removes the dependency on an uninitialised value
+	 */
+	const uint8_t *tdi = (type != SCAN_IN) ? buffer : NULL;
+	uint8_t *tdo = (type != SCAN_OUT) ? buffer : NULL;
 
-		if (type != SCAN_OUT) {
-			if (bitbang_interface->buf_size) {
-				if (bitbang_interface->sample() != ERROR_OK)
-					return ERROR_FAIL;
-				buffered++;
-			} else {
-				switch (bitbang_interface->read()) {
-					case BB_LOW:
-						buffer[bytec] &= ~bcval;
-						break;
-					case BB_HIGH:
-						buffer[bytec] |= bcval;
-						break;
-					default:
-						return ERROR_FAIL;
-				}
-			}
+	/* TMS stays low up to the last bit, which leaves the shift state and
+	 * goes out together with the rest of the path to the end state.
+	 */
+	if (scan_size > 0) {
+		unsigned last = scan_size - 1;
+		uint8_t last_tms[2] = { 1, 0 };
+		uint8_t last_tdi[2] = { 0, 0 };
+		uint8_t last_tdo[2];
+		unsigned last_count = 1;
+
+		if (tdi)
+			last_tdi[0] = (tdi[last / 8] >> (last % 8)) & 1;
+		if (tap_get_state() != tap_get_end_state()) {
+			/* we *KNOW* the last bit transitions out of the
+			 * shift state, so we skip the first state of the
+			 * path and move directly to the end state.
+			 */
+			last_count += tap_append_tms_path(last_tms, 1,
+					tap_get_state(), tap_get_end_state(), 1);
 		}
 
-		if (bitbang_interface->write(1, tms, tdi) != ERROR_OK)
+		if (bitbang_shift(NULL, tdi, tdo, last) != ERROR_OK)
 			return ERROR_FAIL;
-
-		if (type != SCAN_OUT && bitbang_interface->buf_size &&
-				(buffered == bitbang_interface->buf_size ||
-				 bit_cnt == scan_size - 1)) {
-			for (unsigned i = bit_cnt + 1 - buffered; i <= bit_cnt; i++) {
-				switch (bitbang_interface->read_sample()) {
-					case BB_LOW:
-						buffer[i/8] &= ~(1 << (i % 8));
-						break;
-					case BB_HIGH:
-						buffer[i/8] |= 1 << (i % 8);
-						break;
-					default:
-						return ERROR_FAIL;
-				}
-			}
-			buffered = 0;
+		if (bitbang_shift(last_tms, last_tdi, tdo ? last_tdo : NULL, last_count) != ERROR_OK)
+			return ERROR_FAIL;
+		if (tdo) {
+			if (last_tdo[0] & 1)
+				tdo[last / 8] |= 1 << (last % 8);
+			else
+				tdo[last / 8] &= ~(1 << (last % 8));
 		}
-	}
-
-	if (tap_get_state() != tap_get_end_state()) {
-		/* we *KNOW* the above loop transitioned out of
-		 * the shift state, so we skip the first state
-		 * and move directly to the end state.
-		 */
+		tap_set_state(tap_get_end_state());
+	} else if (tap_get_state() != tap_get_end_state()) {
 		if (bitbang_state_move(1) != ERROR_OK)
 			return ERROR_FAIL;
 	}
@@ -369,7 +407,7 @@ int bitbang_execute_queue(void)
 				break;
 			case JTAG_SCAN:
 				bitbang_end_state(cmd->cmd.scan->end_state);
-				scan_size = jtag_build_buffer(cmd->cmd.scan, &buffer);
+				scan_size = jtag_build_buffer_scratch(cmd->cmd.scan, &buffer);
 #ifdef _DEBUG_JTAG_IO_
 				LOG_DEBUG("%s scan %d bits; end in %s",
 						(cmd->cmd.scan->ir_scan) ? "IR" : "DR",
@@ -382,8 +420,6 @@ int bitbang_execute_queue(void)
 					return ERROR_FAIL;
 				if (jtag_read_buffer(buffer, cmd->cmd.scan) != ERROR_OK)
 					retval = ERROR_JTAG_QUEUE_FAILED;
-				if (buffer)
-					free(buffer);
 				break;
 			case JTAG_SLEEP:
 #ifdef _DEBUG_JTAG_IO_
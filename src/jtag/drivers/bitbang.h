@@ -51,6 +51,14 @@ struct bitbang_interface {
 
 	/** Set TCK, TMS, and TDI to the given values. */
 	int (*write)(int tck, int tms, int tdi);
+
+	/** Optional bulk JTAG shift, used instead of write() and read() or
+	 * sample() when set. Clock @a num_bits bits, taking TMS and TDI from
+	 * @a tms and @a tdi (LSB first, NULL means all zero) and, if @a tdo is
+	 * not NULL, storing TDO sampled before each rising edge of TCK.
+	 * @a tdo may point to the same buffer as @a tdi. TCK is left low. */
+	int (*shift)(const uint8_t *tms, const uint8_t *tdi, uint8_t *tdo,
+			unsigned num_bits);
 	int (*reset)(int trst, int srst);
 	int (*blink)(int on);
 	int (*swdio_read)(void);
@@ -1257,26 +1257,27 @@ static void cmsis_dap_add_tms_sequence(const uint8_t *sequence, int s_len)
 	   because even though it seems ridiculously inefficient, it
 	   allows us to combine TMS and scan sequences into the same
 	   USB packet. */
-	/* TODO: combine runs of the same tms value */
-	for (int i = 0; i < s_len; ++i) {
-		bool bit = (sequence[i / 8] & (1 << (i % 8))) != 0;
-		cmsis_dap_add_jtag_sequence(1, NULL, 0, bit, NULL, 0);
+	/* each run of the same tms value is one sequence */
+	int run_start = 0;
+	for (int i = 1; i <= s_len; ++i) {
+		bool bit = (sequence[run_start / 8] & (1 << (run_start % 8))) != 0;
+		if (i < s_len && ((sequence[i / 8] & (1 << (i % 8))) != 0) == bit)
+			continue;
+		cmsis_dap_add_jtag_sequence(i - run_start, NULL, 0, bit, NULL, 0);
+		run_start = i;
 	}
 }
 
 /* Move to the end state by queuing a sequence to clock into TMS */
 static void cmsis_dap_state_move(void)
 {
-	uint8_t tms_scan;
-	uint8_t tms_scan_bits;
-
-	tms_scan = tap_get_tms_path(tap_get_state(), tap_get_end_state());
-	tms_scan_bits = tap_get_tms_path_len(tap_get_state(), tap_get_end_state());
+	const struct tap_tms_path *path =
+		tap_get_tms_path_entry(tap_get_state(), tap_get_end_state());
 
 	DEBUG_JTAG_IO("state move from %s to %s: %d clocks, %02X on tms",
 		tap_state_name(tap_get_state()), tap_state_name(tap_get_end_state()),
-		tms_scan_bits, tms_scan);
-	cmsis_dap_add_tms_sequence(&tms_scan, tms_scan_bits);
+		path->bit_count, path->bits);
+	cmsis_dap_add_tms_sequence(&path->bits, path->bit_count);
 
 	tap_set_state(tap_get_end_state());
 }
@@ -1418,19 +1419,28 @@ static void cmsis_dap_execute_pathmove(struct jtag_command *cmd)
 
 static void cmsis_dap_stableclocks(int num_cycles)
 {
-	int i;
-
-	uint8_t tms = tap_get_state() == TAP_RESET;
-	/* TODO: Perform optimizations? */
-	/* Execute num_cycles. */
-	for (i = 0; i < num_cycles; i++)
-		cmsis_dap_add_tms_sequence(&tms, 1);
+	bool tms = tap_get_state() == TAP_RESET;
+	/* Execute num_cycles, split into sequences of 64 clocks. */
+	cmsis_dap_add_jtag_sequence(num_cycles, NULL, 0, tms, NULL, 0);
 }
 
+/* runtests up to this length go out as one precomputed TMS sequence */
+#define CMSIS_DAP_RUNTEST_MAX_CYCLES	64
+
 static void cmsis_dap_runtest(int num_cycles)
 {
 	tap_state_t saved_end_state = tap_get_end_state();
 
+	if (num_cycles <= CMSIS_DAP_RUNTEST_MAX_CYCLES) {
+		uint8_t tms[TAP_TMS_RUNTEST_BYTES(CMSIS_DAP_RUNTEST_MAX_CYCLES)];
+		unsigned tms_count = tap_append_tms_runtest(tms, 0, tap_get_state(), 0,
+				num_cycles, saved_end_state);
+
+		cmsis_dap_add_tms_sequence(tms, tms_count);
+		tap_set_state(saved_end_state);
+		return;
+	}
+
 	/* Only do a state_move when we're not already in IDLE. */
 	if (tap_get_state() != TAP_IDLE) {
 		cmsis_dap_end_state(TAP_IDLE);
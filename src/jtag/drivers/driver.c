@@ -118,18 +118,32 @@ int interface_jtag_add_ir_scan(struct jtag_tap *active,
 int interface_jtag_add_dr_scan(struct jtag_tap *active, int in_num_fields,
 		const struct scan_field *in_fields, tap_state_t state)
 {
-	/* count devices in bypass */
+	/* count devices in bypass, ahead of and behind the active TAP */
 
-	size_t bypass_devices = 0;
+	unsigned bypass_before = 0;
+	unsigned bypass_after = 0;
+	bool found_active = false;
 
 	for (struct jtag_tap *tap = jtag_tap_next_enabled(NULL); tap != NULL; tap = jtag_tap_next_enabled(tap)) {
-		if (tap->bypass)
-			bypass_devices++;
+		if (!tap->bypass) {
+			assert(active == tap);
+			found_active = true;
+		} else if (found_active)
+			bypass_after++;
+		else
+			bypass_before++;
 	}
 
+	/* must have at least one input field for the not bypassed TAP */
+	assert(found_active && in_num_fields > 0);
+
+	/* every bypassed TAP adds a dummy bit; those on either side of the
+	 * active TAP are merged into a single field */
+	int num_fields = in_num_fields + (bypass_before ? 1 : 0) + (bypass_after ? 1 : 0);
+
 	struct jtag_command *cmd = cmd_queue_alloc(sizeof(struct jtag_command));
 	struct scan_command *scan = cmd_queue_alloc(sizeof(struct scan_command));
-	struct scan_field *out_fields = cmd_queue_alloc((in_num_fields + bypass_devices) * sizeof(struct scan_field));
+	struct scan_field *out_fields = cmd_queue_alloc(num_fields * sizeof(struct scan_field));
 
 	jtag_queue_command(cmd);
 
@@ -137,45 +151,35 @@ int interface_jtag_add_dr_scan(struct jtag_tap *active, int in_num_fields,
 	cmd->cmd.scan = scan;
 
 	scan->ir_scan = false;
-	scan->num_fields = in_num_fields + bypass_devices;
+	scan->num_fields = num_fields;
 	scan->fields = out_fields;
 	scan->end_state = state;
 
 	struct scan_field *field = out_fields;	/* keep track where we insert data */
 
-	/* loop over all enabled TAPs */
-
-	for (struct jtag_tap *tap = jtag_tap_next_enabled(NULL); tap != NULL; tap = jtag_tap_next_enabled(tap)) {
-		/* if TAP is not bypassed insert matching input fields */
-
-		if (!tap->bypass) {
-			assert(active == tap);
-#ifndef NDEBUG
-			/* remember initial position for assert() */
-			struct scan_field *start_field = field;
-#endif /* NDEBUG */
-
-			for (int j = 0; j < in_num_fields; j++) {
-				jtag_scan_field_clone(field, in_fields + j);
-
-				field++;
-			}
-
-			assert(field > start_field);	/* must have at least one input field per not bypassed TAP */
-		}
+	if (bypass_before) {
+		field->num_bits = bypass_before;
+		field->out_value = NULL;
+		field->in_value = NULL;
+		field++;
+	}
 
-		/* if a TAP is bypassed, generated a dummy bit*/
-		else {
-			field->num_bits = 1;
-			field->out_value = NULL;
-			field->in_value = NULL;
+	for (int j = 0; j < in_num_fields; j++) {
+		jtag_scan_field_clone(field, in_fields + j);
+		field++;
+	}
 
-			field++;
-		}
+	if (bypass_after) {
+		field->num_bits = bypass_after;
+		field->out_value = NULL;
+		field->in_value = NULL;
+		field++;
 	}
 
 	assert(field == out_fields + scan->num_fields); /* no superfluous input fields permitted */
 
+	jtag_command_queue_count_dr_scan(bypass_before + bypass_after);
+
 	return ERROR_OK;
 }
 
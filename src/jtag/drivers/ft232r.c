@@ -622,13 +622,11 @@ static int syncbb_execute_queue(void)
 					tap_state_name(cmd->cmd.scan->end_state));
 
 				syncbb_end_state(cmd->cmd.scan->end_state);
-				scan_size = jtag_build_buffer(cmd->cmd.scan, &buffer);
+				scan_size = jtag_build_buffer_scratch(cmd->cmd.scan, &buffer);
 				type = jtag_scan_type(cmd->cmd.scan);
 				syncbb_scan(cmd->cmd.scan->ir_scan, type, buffer, scan_size);
 				if (jtag_read_buffer(buffer, cmd->cmd.scan) != ERROR_OK)
 					retval = ERROR_JTAG_QUEUE_FAILED;
-				if (buffer)
-					free(buffer);
 				break;
 
 			case JTAG_SLEEP:
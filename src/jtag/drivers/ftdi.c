@@ -257,21 +257,16 @@ static void move_to_state(tap_state_t goal_state)
 		start state.
 	*/
 
-	/* do the 2 lookups */
-	uint8_t tms_bits  = tap_get_tms_path(start_state, goal_state);
-	int tms_count = tap_get_tms_path_len(start_state, goal_state);
-	assert(tms_count <= 8);
+	const struct tap_tms_path *path = tap_get_tms_path_entry(start_state, goal_state);
 
 	DEBUG_JTAG_IO("start=%s goal=%s", tap_state_name(start_state), tap_state_name(goal_state));
 
-	/* Track state transitions step by step */
-	for (int i = 0; i < tms_count; i++)
-		tap_set_state(tap_state_transition(tap_get_state(), (tms_bits >> i) & 1));
+	tap_set_state(goal_state);
 
 	mpsse_clock_tms_cs_out(mpsse_ctx,
-		&tms_bits,
+		&path->bits,
 		0,
-		tms_count,
+		path->bit_count,
 		false,
 		ftdi_jtag_mode);
 }
@@ -319,15 +314,42 @@ static void ftdi_end_state(tap_state_t state)
 	}
 }
 
+/* runtests up to this length go out as one precomputed TMS sequence */
+#define FTDI_RUNTEST_MAX_CYCLES	64
+
 static void ftdi_execute_runtest(struct jtag_command *cmd)
 {
 	int i;
 	uint8_t zero = 0;
+	struct jtag_command *next = cmd->next;
+	tap_state_t goal_state = cmd->cmd.runtest->end_state;
 
 	DEBUG_JTAG_IO("runtest %i cycles, end in %s",
 		cmd->cmd.runtest->num_cycles,
 		tap_state_name(cmd->cmd.runtest->end_state));
 
+	ftdi_end_state(cmd->cmd.runtest->end_state);
+
+	/* A scan up next would enter its shift state straight from RUN/IDLE;
+	 * clock that path as part of this sequence instead. */
+	if (goal_state == TAP_IDLE && next && next->type == JTAG_SCAN
+			&& jtag_scan_size(next->cmd.scan) > 0)
+		goal_state = next->cmd.scan->ir_scan ? TAP_IRSHIFT : TAP_DRSHIFT;
+
+	if (cmd->cmd.runtest->num_cycles <= FTDI_RUNTEST_MAX_CYCLES) {
+		uint8_t tms[TAP_TMS_RUNTEST_BYTES(FTDI_RUNTEST_MAX_CYCLES)];
+		unsigned tms_count = tap_append_tms_runtest(tms, 0, tap_get_state(), 0,
+				cmd->cmd.runtest->num_cycles, goal_state);
+
+		mpsse_clock_tms_cs_out(mpsse_ctx, tms, 0, tms_count, false, ftdi_jtag_mode);
+		tap_set_state(goal_state);
+
+		DEBUG_JTAG_IO("runtest: %i, end in %s",
+			cmd->cmd.runtest->num_cycles,
+			tap_state_name(goal_state));
+		return;
+	}
+
 	if (tap_get_state() != TAP_IDLE)
 		move_to_state(TAP_IDLE);
 
@@ -340,10 +362,8 @@ static void ftdi_execute_runtest(struct jtag_command *cmd)
 		i -= this_len;
 	}
 
-	ftdi_end_state(cmd->cmd.runtest->end_state);
-
-	if (tap_get_state() != tap_get_end_state())
-		move_to_state(tap_get_end_state());
+	if (tap_get_state() != goal_state)
+		move_to_state(goal_state);
 
 	DEBUG_JTAG_IO("runtest: %i, end in %s",
 		cmd->cmd.runtest->num_cycles,
@@ -492,13 +512,23 @@ static void ftdi_execute_scan(struct jtag_command *cmd)
 					last_bit,
 					ftdi_jtag_mode);
 			tap_set_state(tap_state_transition(tap_get_state(), 1));
+
+			/* one more cycle with TMS low gets us into a PAUSE state,
+			 * the path on to the end state follows in the same command */
+			uint8_t tms_exit[2] = { 0, 0 };
+			unsigned tms_exit_count = 1;
+			tap_set_state(tap_state_transition(tap_get_state(), 0));
+			if (tap_get_state() != tap_get_end_state()) {
+				tms_exit_count += tap_append_tms_path(tms_exit, 1,
+						tap_get_state(), tap_get_end_state(), 0);
+				tap_set_state(tap_get_end_state());
+			}
 			mpsse_clock_tms_cs_out(mpsse_ctx,
-					&tms_bits,
-					1,
-					1,
+					tms_exit,
+					0,
+					tms_exit_count,
 					last_bit,
 					ftdi_jtag_mode);
-			tap_set_state(tap_state_transition(tap_get_state(), 0));
 		} else
 			mpsse_clock_data(mpsse_ctx,
 				field->out_value,
@@ -84,6 +84,8 @@ static inline bool gpio_level(int g)
 
 static bb_value_t imx_gpio_read(void);
 static int imx_gpio_write(int tck, int tms, int tdi);
+static int imx_gpio_shift(const uint8_t *tms, const uint8_t *tdi,
+		uint8_t *tdo, unsigned num_bits);
 static int imx_gpio_reset(int trst, int srst);
 
 static int imx_gpio_swdio_read(void);
@@ -95,6 +97,7 @@ static int imx_gpio_quit(void);
 static struct bitbang_interface imx_gpio_bitbang = {
 	.read = imx_gpio_read,
 	.write = imx_gpio_write,
+	.shift = imx_gpio_shift,
 	.reset = imx_gpio_reset,
 	.swdio_read = imx_gpio_swdio_read,
 	.swdio_drive = imx_gpio_swdio_drive,
@@ -145,6 +148,71 @@ static int imx_gpio_write(int tck, int tms, int tdi)
 	return ERROR_OK;
 }
 
+/* JTAG bulk shift. When TCK, TMS and TDI sit in the same GPIO bank the
+ * data register is written once per edge instead of three read-modify-
+ * write cycles. */
+static int imx_gpio_shift(const uint8_t *tms, const uint8_t *tdi,
+		uint8_t *tdo, unsigned num_bits)
+{
+	int bank = tck_gpio / 32;
+	int tms_bit = 0;
+	int tdi_bit = 0;
+
+	if (tms_gpio / 32 != bank || tdi_gpio / 32 != bank) {
+		for (unsigned i = 0; i < num_bits; i++) {
+			tms_bit = tms && (tms[i / 8] & (1 << (i % 8)));
+			tdi_bit = tdi && (tdi[i / 8] & (1 << (i % 8)));
+			imx_gpio_write(0, tms_bit, tdi_bit);
+			if (tdo) {
+				if (gpio_level(tdo_gpio))
+					tdo[i / 8] |= 1 << (i % 8);
+				else
+					tdo[i / 8] &= ~(1 << (i % 8));
+			}
+			imx_gpio_write(1, tms_bit, tdi_bit);
+		}
+		return imx_gpio_write(0, tms_bit, tdi_bit);
+	}
+
+	uint32_t tck_mask = 1u << (tck_gpio & 0x1F);
+	uint32_t tms_mask = 1u << (tms_gpio & 0x1F);
+	uint32_t tdi_mask = 1u << (tdi_gpio & 0x1F);
+	uint32_t dr = pio_base[bank].dr;
+
+	for (unsigned i = 0; i < num_bits; i++) {
+		unsigned bytec = i / 8;
+		uint8_t bcval = 1 << (i % 8);
+
+		dr &= ~(tck_mask | tms_mask | tdi_mask);
+		if (tms && (tms[bytec] & bcval))
+			dr |= tms_mask;
+		if (tdi && (tdi[bytec] & bcval))
+			dr |= tdi_mask;
+		pio_base[bank].dr = dr;
+		for (unsigned int j = 0; j < jtag_delay; j++)
+			asm volatile ("");
+
+		if (tdo) {
+			if (gpio_level(tdo_gpio))
+				tdo[bytec] |= bcval;
+			else
+				tdo[bytec] &= ~bcval;
+		}
+
+		dr |= tck_mask;
+		pio_base[bank].dr = dr;
+		for (unsigned int j = 0; j < jtag_delay; j++)
+			asm volatile ("");
+	}
+
+	dr &= ~tck_mask;
+	pio_base[bank].dr = dr;
+	for (unsigned int j = 0; j < jtag_delay; j++)
+		asm volatile ("");
+
+	return ERROR_OK;
+}
+
 static int imx_gpio_swd_write(int tck, int tms, int tdi)
 {
 	tdi ? gpio_set(swdio_gpio) : gpio_clear(swdio_gpio);
@@ -28,6 +28,10 @@
 #ifdef HAVE_ARPA_INET_H
 #include <arpa/inet.h>
 #endif
+#ifndef _WIN32
+#include <sys/un.h>
+#include <netinet/tcp.h>
+#endif
 
 #define NO_TAP_SHIFT	0
 #define TAP_SHIFT	1
@@ -43,12 +47,50 @@
 #define CMD_SCAN_CHAIN_FLIP_TMS	3
 #define CMD_STOP_SIMU		4
 
+/* Extended protocol, see contrib/jtag_vpi/jtag_vpi_server.c. It is only
+ * requested when enabled with jtag_vpi_set_extended, the server must then
+ * answer within EXT_PROBE_TIMEOUT_MS. */
+#define CMD_EXTENDED		0x10
+#define CMD_FLUSH			0x11	/* version 2: return deferred TDO */
+#define EXT_MAGIC			"OCDX"
+#define EXT_VERSION			2
+#define EXT_PROBE_TIMEOUT_MS	10000
+
+/* extended command header: cmd, flags, two reserved bytes, u32 nb_bits,
+ * followed by DIV_ROUND_UP(nb_bits, 8) bytes unless EXT_FLAG_TDI_ONES */
+#define EXT_HEADER_SIZE		8
+#define EXT_FLAG_TDI_ONES	0x01
+#define EXT_FLAG_DEFER		0x02	/* version 2: keep TDO for CMD_FLUSH */
+#define EXT_FLAG_NO_TDO		0x04	/* version 2: don't return TDO at all */
+
 int server_port = SERVER_PORT;
 char *server_address;
+static char *server_unix_socket;
+static bool jtag_vpi_try_extended;
+static bool jtag_vpi_extended;
+/* server of version 2 or later: the whole queue is sent in one go and all
+ * captured TDO comes back in a single reply to CMD_FLUSH */
+static bool jtag_vpi_batch;
+
+struct jtag_vpi_pending_scan {
+	struct scan_command *cmd;
+	uint8_t *buf;
+	int nb_bytes;
+};
+
+static struct jtag_vpi_pending_scan *jtag_vpi_pending;
+static unsigned jtag_vpi_num_pending;
+static unsigned jtag_vpi_max_pending;
 
 int sockfd;
 struct sockaddr_in serv_addr;
 
+/* Commands without a reply are collected here and written together, just
+ * before a reply is awaited or at the end of the queue. */
+static uint8_t *jtag_vpi_out;
+static size_t jtag_vpi_out_len;
+static size_t jtag_vpi_out_size;
+
 struct vpi_cmd {
 	int cmd;
 	unsigned char buffer_out[XFERT_MAX_SIZE];
@@ -57,24 +99,100 @@ struct vpi_cmd {
 	int nb_bits;
 };
 
-static int jtag_vpi_send_cmd(struct vpi_cmd *vpi)
+static int jtag_vpi_queue_out(const void *data, size_t len)
 {
-	int retval = write_socket(sockfd, vpi, sizeof(struct vpi_cmd));
-	if (retval <= 0)
-		return ERROR_FAIL;
+	if (jtag_vpi_out_len + len > jtag_vpi_out_size) {
+		size_t size = MAX(jtag_vpi_out_size * 2, jtag_vpi_out_len + len);
+		uint8_t *out = realloc(jtag_vpi_out, size);
+		if (out == NULL) {
+			LOG_ERROR("jtag_vpi: out of memory");
+			return ERROR_FAIL;
+		}
+		jtag_vpi_out = out;
+		jtag_vpi_out_size = size;
+	}
 
+	memcpy(jtag_vpi_out + jtag_vpi_out_len, data, len);
+	jtag_vpi_out_len += len;
 	return ERROR_OK;
 }
 
-static int jtag_vpi_receive_cmd(struct vpi_cmd *vpi)
+static int jtag_vpi_flush(void)
 {
-	int retval = read_socket(sockfd, vpi, sizeof(struct vpi_cmd));
-	if (retval < (int)sizeof(struct vpi_cmd))
-		return ERROR_FAIL;
+	size_t done = 0;
+
+	while (done < jtag_vpi_out_len) {
+		int retval = write_socket(sockfd, jtag_vpi_out + done,
+				jtag_vpi_out_len - done);
+		if (retval <= 0) {
+			LOG_ERROR("jtag_vpi: write failed");
+			jtag_vpi_out_len = 0;
+			return ERROR_FAIL;
+		}
+		done += retval;
+	}
 
+	jtag_vpi_out_len = 0;
 	return ERROR_OK;
 }
 
+static int jtag_vpi_receive(void *data, size_t len)
+{
+	uint8_t *p = data;
+	size_t done = 0;
+
+	int retval = jtag_vpi_flush();
+	if (retval != ERROR_OK)
+		return retval;
+
+	while (done < len) {
+		retval = read_socket(sockfd, p + done, len - done);
+		if (retval <= 0) {
+			LOG_ERROR("jtag_vpi: read failed");
+			return ERROR_FAIL;
+		}
+		done += retval;
+	}
+
+	return ERROR_OK;
+}
+
+static int jtag_vpi_discard(int nb_bytes)
+{
+	uint8_t discard[XFERT_MAX_SIZE];
+
+	while (nb_bytes > 0) {
+		int n = MIN(nb_bytes, (int)sizeof(discard));
+		int retval = jtag_vpi_receive(discard, n);
+		if (retval != ERROR_OK)
+			return retval;
+		nb_bytes -= n;
+	}
+	return ERROR_OK;
+}
+
+static int jtag_vpi_send_cmd(struct vpi_cmd *vpi)
+{
+	return jtag_vpi_queue_out(vpi, sizeof(struct vpi_cmd));
+}
+
+static int jtag_vpi_receive_cmd(struct vpi_cmd *vpi)
+{
+	return jtag_vpi_receive(vpi, sizeof(struct vpi_cmd));
+}
+
+static int jtag_vpi_send_ext(uint8_t cmd, uint8_t flags, uint32_t nb_bits,
+		const uint8_t *payload)
+{
+	uint8_t header[EXT_HEADER_SIZE] = { cmd, flags, 0, 0 };
+
+	h_u32_to_le(header + 4, nb_bits);
+	int retval = jtag_vpi_queue_out(header, sizeof(header));
+	if (retval != ERROR_OK || !payload)
+		return retval;
+	return jtag_vpi_queue_out(payload, DIV_ROUND_UP(nb_bits, 8));
+}
+
 /**
  * jtag_vpi_reset - ask to reset the JTAG device
  * @trst: 1 if TRST is to be asserted
@@ -84,6 +202,10 @@ static int jtag_vpi_reset(int trst, int srst)
 {
 	struct vpi_cmd vpi;
 
+	if (jtag_vpi_extended)
+		return jtag_vpi_send_ext(CMD_RESET, 0, 0, NULL);
+
+	memset(&vpi, 0, sizeof(vpi));
 	vpi.cmd = CMD_RESET;
 	vpi.length = 0;
 	return jtag_vpi_send_cmd(&vpi);
@@ -105,8 +227,12 @@ static int jtag_vpi_tms_seq(const uint8_t *bits, int nb_bits)
 	struct vpi_cmd vpi;
 	int nb_bytes;
 
+	if (jtag_vpi_extended)
+		return jtag_vpi_send_ext(CMD_TMS_SEQ, 0, nb_bits, bits);
+
 	nb_bytes = DIV_ROUND_UP(nb_bits, 8);
 
+	memset(&vpi, 0, sizeof(vpi));
 	vpi.cmd = CMD_TMS_SEQ;
 	memcpy(vpi.buffer_out, bits, nb_bytes);
 	vpi.length = nb_bytes;
@@ -155,10 +281,9 @@ static int jtag_vpi_state_move(tap_state_t state)
 	if (tap_get_state() == state)
 		return ERROR_OK;
 
-	uint8_t tms_scan = tap_get_tms_path(tap_get_state(), state);
-	int tms_len = tap_get_tms_path_len(tap_get_state(), state);
+	const struct tap_tms_path *path = tap_get_tms_path_entry(tap_get_state(), state);
 
-	int retval = jtag_vpi_tms_seq(&tms_scan, tms_len);
+	int retval = jtag_vpi_tms_seq(&path->bits, path->bit_count);
 	if (retval != ERROR_OK)
 		return retval;
 
@@ -172,6 +297,7 @@ static int jtag_vpi_queue_tdi_xfer(uint8_t *bits, int nb_bits, int tap_shift)
 	struct vpi_cmd vpi;
 	int nb_bytes = DIV_ROUND_UP(nb_bits, 8);
 
+	memset(&vpi, 0, sizeof(vpi));
 	vpi.cmd = tap_shift ? CMD_SCAN_CHAIN_FLIP_TMS : CMD_SCAN_CHAIN;
 
 	if (bits)
@@ -201,11 +327,36 @@ static int jtag_vpi_queue_tdi_xfer(uint8_t *bits, int nb_bits, int tap_shift)
  * @bits: bits to be queued on TDI (or NULL if 0 are to be queued)
  * @nb_bits: number of bits
  */
+static int jtag_vpi_queue_tdi_ext(uint8_t *bits, int nb_bits, int tap_shift)
+{
+	uint8_t cmd = tap_shift ? CMD_SCAN_CHAIN_FLIP_TMS : CMD_SCAN_CHAIN;
+	int nb_bytes = DIV_ROUND_UP(nb_bits, 8);
+
+	if (jtag_vpi_batch && !bits)
+		return jtag_vpi_send_ext(cmd, EXT_FLAG_TDI_ONES | EXT_FLAG_NO_TDO,
+				nb_bits, NULL);
+
+	int retval = jtag_vpi_send_ext(cmd, bits ? 0 : EXT_FLAG_TDI_ONES,
+			nb_bits, bits);
+	if (retval != ERROR_OK)
+		return retval;
+
+	if (bits)
+		return jtag_vpi_receive(bits, nb_bytes);
+
+	/* nobody wants the TDO of clocks with TDI high */
+	return jtag_vpi_discard(nb_bytes);
+}
+
 static int jtag_vpi_queue_tdi(uint8_t *bits, int nb_bits, int tap_shift)
 {
 	int nb_xfer = DIV_ROUND_UP(nb_bits, XFERT_MAX_SIZE * 8);
 	int retval;
 
+	/* no size limit on extended scans */
+	if (jtag_vpi_extended)
+		return jtag_vpi_queue_tdi_ext(bits, nb_bits, tap_shift);
+
 	while (nb_xfer) {
 		if (nb_xfer ==  1) {
 			retval = jtag_vpi_queue_tdi_xfer(bits, nb_bits, tap_shift);
@@ -227,17 +378,93 @@ static int jtag_vpi_queue_tdi(uint8_t *bits, int nb_bits, int tap_shift)
 }
 
 /**
- * jtag_vpi_clock_tms - clock a TMS transition
- * @tms: the TMS to be sent
+ * jtag_vpi_defer_scan - queue a scan whose TDO is collected at the end
+ * @cmd: the scan command
+ * @buf: scan buffer, owned by the pending list from now on
+ * @scan_bits: length of the scan
+ */
+static int jtag_vpi_defer_scan(struct scan_command *cmd, uint8_t *buf, int scan_bits)
+{
+	uint8_t flags = EXT_FLAG_DEFER;
+	uint8_t vpi_cmd = (cmd->end_state == TAP_DRSHIFT) ?
+		CMD_SCAN_CHAIN : CMD_SCAN_CHAIN_FLIP_TMS;
+
+	if (!buf)
+		flags |= EXT_FLAG_TDI_ONES;
+
+	int retval = jtag_vpi_send_ext(vpi_cmd, flags, scan_bits, buf);
+	if (retval != ERROR_OK)
+		return retval;
+
+	if (jtag_vpi_num_pending == jtag_vpi_max_pending) {
+		unsigned max = jtag_vpi_max_pending ? jtag_vpi_max_pending * 2 : 64;
+		struct jtag_vpi_pending_scan *pending =
+			realloc(jtag_vpi_pending, max * sizeof(*pending));
+		if (pending == NULL) {
+			LOG_ERROR("jtag_vpi: out of memory");
+			return ERROR_FAIL;
+		}
+		jtag_vpi_pending = pending;
+		jtag_vpi_max_pending = max;
+	}
+
+	struct jtag_vpi_pending_scan *p = &jtag_vpi_pending[jtag_vpi_num_pending++];
+	p->cmd = cmd;
+	p->buf = buf;
+	p->nb_bytes = DIV_ROUND_UP(scan_bits, 8);
+	return ERROR_OK;
+}
+
+/**
+ * jtag_vpi_collect_scans - fetch the TDO of all deferred scans
+ * @ok: false to only drop the pending scans after an error
  *
- * Triggers a TMS transition (ie. one JTAG TAP state move).
+ * One CMD_FLUSH, answered by a u32 length and the concatenated TDO of
+ * all deferred scans in queue order.
  */
-static int jtag_vpi_clock_tms(int tms)
+static int jtag_vpi_collect_scans(bool ok)
 {
-	const uint8_t tms_0 = 0;
-	const uint8_t tms_1 = 1;
+	int retval = ERROR_OK;
+	unsigned i;
+
+	if (ok && jtag_vpi_num_pending) {
+		uint8_t len[4];
+
+		retval = jtag_vpi_send_ext(CMD_FLUSH, 0, 0, NULL);
+		if (retval == ERROR_OK)
+			retval = jtag_vpi_receive(len, sizeof(len));
+
+		uint32_t expected = 0;
+		for (i = 0; i < jtag_vpi_num_pending; i++)
+			expected += jtag_vpi_pending[i].nb_bytes;
+		if (retval == ERROR_OK && le_to_h_u32(len) != expected) {
+			LOG_ERROR("jtag_vpi: got %" PRIu32 " bytes of TDO, expected %" PRIu32,
+					le_to_h_u32(len), expected);
+			retval = ERROR_FAIL;
+		}
+
+		/* straight into the scan buffers, in queue order */
+		for (i = 0; retval == ERROR_OK && i < jtag_vpi_num_pending; i++) {
+			struct jtag_vpi_pending_scan *p = &jtag_vpi_pending[i];
+			if (p->buf)
+				retval = jtag_vpi_receive(p->buf, p->nb_bytes);
+			else
+				retval = jtag_vpi_discard(p->nb_bytes);
+		}
+
+		for (i = 0; retval == ERROR_OK && i < jtag_vpi_num_pending; i++) {
+			int ret = jtag_read_buffer(jtag_vpi_pending[i].buf,
+					jtag_vpi_pending[i].cmd);
+			if (ret != ERROR_OK)
+				retval = ret;
+		}
+	}
+
+	for (i = 0; i < jtag_vpi_num_pending; i++)
+		free(jtag_vpi_pending[i].buf);
+	jtag_vpi_num_pending = 0;
 
-	return jtag_vpi_tms_seq(tms ? &tms_1 : &tms_0, 1);
+	return retval;
 }
 
 /**
@@ -254,7 +481,11 @@ static int jtag_vpi_scan(struct scan_command *cmd)
 	uint8_t *buf = NULL;
 	int retval = ERROR_OK;
 
-	scan_bits = jtag_build_buffer(cmd, &buf);
+	/* deferred scans keep their buffer until the TDO arrives */
+	if (jtag_vpi_batch)
+		scan_bits = jtag_build_buffer(cmd, &buf);
+	else
+		scan_bits = jtag_build_buffer_scratch(cmd, &buf);
 
 	if (cmd->ir_scan) {
 		retval = jtag_vpi_state_move(TAP_IRSHIFT);
@@ -266,7 +497,12 @@ static int jtag_vpi_scan(struct scan_command *cmd)
 			return retval;
 	}
 
-	if (cmd->end_state == TAP_DRSHIFT) {
+	if (jtag_vpi_batch) {
+		/* the TDO of this scan comes with the reply to CMD_FLUSH */
+		retval = jtag_vpi_defer_scan(cmd, buf, scan_bits);
+		if (retval != ERROR_OK)
+			return retval;
+	} else if (cmd->end_state == TAP_DRSHIFT) {
 		retval = jtag_vpi_queue_tdi(buf, scan_bits, NO_TAP_SHIFT);
 		if (retval != ERROR_OK)
 			return retval;
@@ -279,27 +515,25 @@ static int jtag_vpi_scan(struct scan_command *cmd)
 	if (cmd->end_state != TAP_DRSHIFT) {
 		/*
 		 * As our JTAG is in an unstable state (IREXIT1 or DREXIT1), move it
-		 * forward to a stable IRPAUSE or DRPAUSE.
+		 * forward to a stable IRPAUSE or DRPAUSE, and from there on to the
+		 * end state within the same TMS sequence.
 		 */
-		retval = jtag_vpi_clock_tms(0);
+		tap_state_t pause_state = cmd->ir_scan ? TAP_IRPAUSE : TAP_DRPAUSE;
+		uint8_t tms_scan[2] = { 0, 0 };
+		int tms_len = 1;
+
+		if (cmd->end_state != pause_state)
+			tms_len += tap_append_tms_path(tms_scan, 1, pause_state, cmd->end_state, 0);
+
+		retval = jtag_vpi_tms_seq(tms_scan, tms_len);
 		if (retval != ERROR_OK)
 			return retval;
 
-		if (cmd->ir_scan)
-			tap_set_state(TAP_IRPAUSE);
-		else
-			tap_set_state(TAP_DRPAUSE);
+		tap_set_state(cmd->end_state);
 	}
 
-	retval = jtag_read_buffer(buf, cmd);
-	if (retval != ERROR_OK)
-		return retval;
-
-	if (buf)
-		free(buf);
-
-	if (cmd->end_state != TAP_DRSHIFT) {
-		retval = jtag_vpi_state_move(cmd->end_state);
+	if (!jtag_vpi_batch) {
+		retval = jtag_read_buffer(buf, cmd);
 		if (retval != ERROR_OK)
 			return retval;
 	}
@@ -307,15 +541,33 @@ static int jtag_vpi_scan(struct scan_command *cmd)
 	return ERROR_OK;
 }
 
+/* runtests up to this length go out as one precomputed TMS sequence */
+#define JTAG_VPI_RUNTEST_MAX_CYCLES	64
+
 static int jtag_vpi_runtest(int cycles, tap_state_t state)
 {
 	int retval;
 
+	if (cycles <= JTAG_VPI_RUNTEST_MAX_CYCLES) {
+		uint8_t tms_scan[TAP_TMS_RUNTEST_BYTES(JTAG_VPI_RUNTEST_MAX_CYCLES)];
+		int tms_len = tap_append_tms_runtest(tms_scan, 0, tap_get_state(), 0,
+				cycles, state);
+
+		if (tms_len > 0) {
+			retval = jtag_vpi_tms_seq(tms_scan, tms_len);
+			if (retval != ERROR_OK)
+				return retval;
+		}
+
+		tap_set_state(state);
+		return ERROR_OK;
+	}
+
 	retval = jtag_vpi_state_move(TAP_IDLE);
 	if (retval != ERROR_OK)
 		return retval;
 
-	retval = jtag_vpi_queue_tdi(NULL, cycles, TAP_SHIFT);
+	retval = jtag_vpi_queue_tdi(NULL, cycles, NO_TAP_SHIFT);
 	if (retval != ERROR_OK)
 		return retval;
 
@@ -355,7 +607,10 @@ static int jtag_vpi_execute_queue(void)
 			retval = jtag_vpi_tms(cmd->cmd.tms);
 			break;
 		case JTAG_SLEEP:
-			jtag_sleep(cmd->cmd.sleep->us);
+			/* whatever precedes the sleep must reach the simulation first */
+			retval = jtag_vpi_flush();
+			if (retval == ERROR_OK)
+				jtag_sleep(cmd->cmd.sleep->us);
 			break;
 		case JTAG_SCAN:
 			retval = jtag_vpi_scan(cmd->cmd.scan);
@@ -363,10 +618,104 @@ static int jtag_vpi_execute_queue(void)
 		}
 	}
 
+	if (jtag_vpi_batch) {
+		int ret = jtag_vpi_collect_scans(retval == ERROR_OK);
+		if (retval == ERROR_OK)
+			retval = ret;
+	}
+
+	if (retval == ERROR_OK)
+		retval = jtag_vpi_flush();
+	else
+		jtag_vpi_out_len = 0;
+
 	return retval;
 }
 
-static int jtag_vpi_init(void)
+/* Ask for the extended protocol with a classic command. Old servers ignore
+ * unknown commands, and a late answer would be taken for the TDO of the
+ * first scan, so there is no falling back to classic: no answer is an
+ * error. */
+static int jtag_vpi_probe(void)
+{
+	struct vpi_cmd vpi;
+
+	memset(&vpi, 0, sizeof(vpi));
+	vpi.cmd = CMD_EXTENDED;
+	memcpy(vpi.buffer_out, EXT_MAGIC, 4);
+	vpi.length = 4;
+	vpi.nb_bits = EXT_VERSION;
+	int retval = jtag_vpi_send_cmd(&vpi);
+	if (retval == ERROR_OK)
+		retval = jtag_vpi_flush();
+	if (retval != ERROR_OK)
+		return retval;
+
+	fd_set rfds;
+	struct timeval tv = {
+		.tv_sec = EXT_PROBE_TIMEOUT_MS / 1000,
+		.tv_usec = (EXT_PROBE_TIMEOUT_MS % 1000) * 1000,
+	};
+	FD_ZERO(&rfds);
+	FD_SET(sockfd, &rfds);
+	retval = socket_select(sockfd + 1, &rfds, NULL, NULL, &tv);
+	if (retval < 0) {
+		LOG_ERROR("jtag_vpi: select failed");
+		return ERROR_FAIL;
+	}
+	if (retval == 0) {
+		LOG_ERROR("jtag_vpi: no answer to the extended protocol request, "
+				"the server may only support the classic protocol "
+				"(jtag_vpi_set_extended off)");
+		return ERROR_FAIL;
+	}
+
+	retval = jtag_vpi_receive_cmd(&vpi);
+	if (retval != ERROR_OK)
+		return retval;
+	if (vpi.cmd != CMD_EXTENDED || memcmp(vpi.buffer_in, EXT_MAGIC, 4)
+			|| vpi.nb_bits < 1) {
+		LOG_ERROR("jtag_vpi: unexpected reply to the protocol probe");
+		return ERROR_FAIL;
+	}
+
+	jtag_vpi_extended = true;
+	jtag_vpi_batch = vpi.nb_bits >= 2;
+	LOG_INFO("jtag_vpi: extended protocol, server version %d%s", vpi.nb_bits,
+			jtag_vpi_batch ? ", batched queues" : "");
+	return ERROR_OK;
+}
+
+static int jtag_vpi_connect_unix(void)
+{
+#ifdef _WIN32
+	LOG_ERROR("jtag_vpi: unix sockets are not supported on this host");
+	return ERROR_FAIL;
+#else
+	struct sockaddr_un addr;
+
+	sockfd = socket(PF_UNIX, SOCK_STREAM, 0);
+	if (sockfd < 0) {
+		LOG_ERROR("Could not create socket");
+		return ERROR_FAIL;
+	}
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, server_unix_socket, sizeof(addr.sun_path) - 1);
+
+	if (connect(sockfd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+		close(sockfd);
+		LOG_ERROR("Can't connect to %s", server_unix_socket);
+		return ERROR_COMMAND_CLOSE_CONNECTION;
+	}
+
+	LOG_INFO("Connection to %s succeed", server_unix_socket);
+	return ERROR_OK;
+#endif
+}
+
+static int jtag_vpi_connect_tcp(void)
 {
 	sockfd = socket(AF_INET, SOCK_STREAM, 0);
 	if (sockfd < 0) {
@@ -395,14 +744,52 @@ static int jtag_vpi_init(void)
 		return ERROR_COMMAND_CLOSE_CONNECTION;
 	}
 
+	/* small commands go out back to back, don't hold them back */
+	int flag = 1;
+	setsockopt(sockfd, IPPROTO_TCP, TCP_NODELAY, (char *)&flag, sizeof(int));
+
 	LOG_INFO("Connection to %s : %u succeed", server_address, server_port);
 
 	return ERROR_OK;
 }
 
+static int jtag_vpi_init(void)
+{
+	int retval;
+
+	if (server_unix_socket)
+		retval = jtag_vpi_connect_unix();
+	else
+		retval = jtag_vpi_connect_tcp();
+	if (retval != ERROR_OK)
+		return retval;
+
+	jtag_vpi_extended = false;
+	jtag_vpi_batch = false;
+	if (jtag_vpi_try_extended) {
+		retval = jtag_vpi_probe();
+		if (retval != ERROR_OK) {
+			close(sockfd);
+			return retval;
+		}
+	}
+
+	return ERROR_OK;
+}
+
 static int jtag_vpi_quit(void)
 {
 	free(server_address);
+	free(server_unix_socket);
+	free(jtag_vpi_out);
+	free(jtag_vpi_pending);
+	jtag_vpi_pending = NULL;
+	jtag_vpi_max_pending = 0;
+	server_address = NULL;
+	server_unix_socket = NULL;
+	jtag_vpi_out = NULL;
+	jtag_vpi_out_len = 0;
+	jtag_vpi_out_size = 0;
 	return close(sockfd);
 }
 
@@ -433,6 +820,29 @@ COMMAND_HANDLER(jtag_vpi_set_address)
 	return ERROR_OK;
 }
 
+COMMAND_HANDLER(jtag_vpi_set_unix_socket)
+{
+	if (CMD_ARGC != 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	free(server_unix_socket);
+	server_unix_socket = strdup(CMD_ARGV[0]);
+
+	LOG_INFO("Set server unix socket to %s", server_unix_socket);
+
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(jtag_vpi_set_extended)
+{
+	if (CMD_ARGC != 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	COMMAND_PARSE_ON_OFF(CMD_ARGV[0], jtag_vpi_try_extended);
+
+	return ERROR_OK;
+}
+
 static const struct command_registration jtag_vpi_command_handlers[] = {
 	{
 		.name = "jtag_vpi_set_port",
@@ -448,6 +858,21 @@ static const struct command_registration jtag_vpi_command_handlers[] = {
 		.help = "set the address of the VPI server",
 		.usage = "description_string",
 	},
+	{
+		.name = "jtag_vpi_set_unix_socket",
+		.handler = &jtag_vpi_set_unix_socket,
+		.mode = COMMAND_CONFIG,
+		.help = "connect to the VPI server through a unix socket "
+			"instead of TCP",
+		.usage = "path",
+	},
+	{
+		.name = "jtag_vpi_set_extended",
+		.handler = &jtag_vpi_set_extended,
+		.mode = COMMAND_CONFIG,
+		.help = "request and use the extended protocol (default off)",
+		.usage = "on|off",
+	},
 	COMMAND_REGISTRATION_DONE
 };
 
@@ -36,6 +36,15 @@ static char *remote_bitbang_port;
 static FILE *remote_bitbang_file;
 static int remote_bitbang_fd;
 
+/* Extended protocol: probed at init unless disabled, see
+ * doc/manual/jtag/drivers/remote_bitbang.txt */
+static bool remote_bitbang_try_extended = true;
+static bool remote_bitbang_extended;
+
+/* request/response buffer for 'S' shift commands, grown to the largest scan */
+static uint8_t *remote_bitbang_xbuf;
+static size_t remote_bitbang_xbuf_size;
+
 /* Circular buffer. When start == end, the buffer is empty. */
 static char remote_bitbang_buf[64];
 static unsigned remote_bitbang_start;
@@ -116,6 +125,11 @@ static int remote_bitbang_quit(void)
 
 	free(remote_bitbang_host);
 	free(remote_bitbang_port);
+	free(remote_bitbang_xbuf);
+	remote_bitbang_host = NULL;
+	remote_bitbang_port = NULL;
+	remote_bitbang_xbuf = NULL;
+	remote_bitbang_xbuf_size = 0;
 
 	LOG_INFO("remote_bitbang interface quit");
 	return ERROR_OK;
@@ -182,6 +196,159 @@ static int remote_bitbang_write(int tck, int tms, int tdi)
 	return remote_bitbang_putc(c);
 }
 
+/* TDO samples requested per round trip by remote_bitbang_shift_classic();
+ * small enough that the replies always fit in the socket buffers */
+#define REMOTE_BITBANG_SHIFT_CHUNK	1024
+
+/* extended protocol 'S' command: 'S', u32 bit count, flags, vectors */
+#define REMOTE_BITBANG_SHIFT_HEADER	6
+#define REMOTE_BITBANG_SHIFT_TDO	0x01
+#define REMOTE_BITBANG_SHIFT_TMS	0x02
+#define REMOTE_BITBANG_SHIFT_TDI	0x04
+
+static int remote_bitbang_read_all(void *buf, size_t count);
+
+/* Send a whole chunk of clock/sample commands with one write and collect
+ * all the replies afterwards, instead of one character per call. */
+static int remote_bitbang_shift_classic(const uint8_t *tms, const uint8_t *tdi,
+		uint8_t *tdo, unsigned num_bits)
+{
+	char cmd[REMOTE_BITBANG_SHIFT_CHUNK * 3 + 1];
+	char reply[REMOTE_BITBANG_SHIFT_CHUNK];
+	int tms_bit = 0;
+	int tdi_bit = 0;
+
+	for (unsigned start = 0; start < num_bits; start += REMOTE_BITBANG_SHIFT_CHUNK) {
+		unsigned count = MIN(num_bits - start, REMOTE_BITBANG_SHIFT_CHUNK);
+		size_t len = 0;
+
+		for (unsigned i = start; i < start + count; i++) {
+			tms_bit = tms && (tms[i / 8] & (1 << (i % 8)));
+			tdi_bit = tdi && (tdi[i / 8] & (1 << (i % 8)));
+			char c = '0' + ((tms_bit ? 0x2 : 0x0) | (tdi_bit ? 0x1 : 0x0));
+			cmd[len++] = c;
+			if (tdo)
+				cmd[len++] = 'R';
+			cmd[len++] = c + 0x4;
+		}
+		if (start + count == num_bits)
+			cmd[len++] = '0' + ((tms_bit ? 0x2 : 0x0) | (tdi_bit ? 0x1 : 0x0));
+
+		if (fwrite(cmd, 1, len, remote_bitbang_file) != len) {
+			LOG_ERROR("remote_bitbang_shift: %s", strerror(errno));
+			return ERROR_FAIL;
+		}
+		if (!tdo)
+			continue;
+
+		if (EOF == fflush(remote_bitbang_file)) {
+			remote_bitbang_quit();
+			LOG_ERROR("fflush: %s", strerror(errno));
+			return ERROR_FAIL;
+		}
+		if (remote_bitbang_read_all(reply, count) != ERROR_OK) {
+			remote_bitbang_quit();
+			return ERROR_FAIL;
+		}
+
+		for (unsigned i = 0; i < count; i++) {
+			unsigned bit = start + i;
+			switch (char_to_int(reply[i])) {
+				case BB_LOW:
+					tdo[bit / 8] &= ~(1 << (bit % 8));
+					break;
+				case BB_HIGH:
+					tdo[bit / 8] |= 1 << (bit % 8);
+					break;
+				default:
+					return ERROR_FAIL;
+			}
+		}
+	}
+
+	return ERROR_OK;
+}
+
+static int remote_bitbang_read_all(void *buf, size_t count)
+{
+	uint8_t *p = buf;
+
+	socket_block(remote_bitbang_fd);
+	for (size_t got = 0; got < count; ) {
+		ssize_t n = read(remote_bitbang_fd, p + got, count - got);
+		if (n <= 0) {
+			LOG_ERROR("read: count=%d, error=%s", (int) n, strerror(errno));
+			return ERROR_FAIL;
+		}
+		got += n;
+	}
+	return ERROR_OK;
+}
+
+/* One 'S' command per call: the whole TMS/TDI vectors go out in a single
+ * write, TDO comes back packed eight bits per byte. */
+static int remote_bitbang_shift_extended(const uint8_t *tms, const uint8_t *tdi,
+		uint8_t *tdo, unsigned num_bits)
+{
+	size_t num_bytes = DIV_ROUND_UP(num_bits, 8);
+	size_t len = REMOTE_BITBANG_SHIFT_HEADER +
+		(tms ? num_bytes : 0) + (tdi ? num_bytes : 0);
+
+	if (len > remote_bitbang_xbuf_size) {
+		uint8_t *xbuf = realloc(remote_bitbang_xbuf, len);
+		if (xbuf == NULL) {
+			LOG_ERROR("remote_bitbang: out of memory");
+			return ERROR_FAIL;
+		}
+		remote_bitbang_xbuf = xbuf;
+		remote_bitbang_xbuf_size = len;
+	}
+
+	uint8_t *p = remote_bitbang_xbuf;
+	*p++ = 'S';
+	h_u32_to_le(p, num_bits);
+	p += 4;
+	*p++ = (tdo ? REMOTE_BITBANG_SHIFT_TDO : 0) |
+		(tms ? REMOTE_BITBANG_SHIFT_TMS : 0) |
+		(tdi ? REMOTE_BITBANG_SHIFT_TDI : 0);
+	if (tms) {
+		memcpy(p, tms, num_bytes);
+		p += num_bytes;
+	}
+	if (tdi) {
+		memcpy(p, tdi, num_bytes);
+		p += num_bytes;
+	}
+
+	if (fwrite(remote_bitbang_xbuf, 1, len, remote_bitbang_file) != len) {
+		LOG_ERROR("remote_bitbang_shift: %s", strerror(errno));
+		return ERROR_FAIL;
+	}
+	if (!tdo)
+		return ERROR_OK;
+
+	if (EOF == fflush(remote_bitbang_file)) {
+		remote_bitbang_quit();
+		LOG_ERROR("fflush: %s", strerror(errno));
+		return ERROR_FAIL;
+	}
+	if (remote_bitbang_read_all(remote_bitbang_xbuf, num_bytes) != ERROR_OK) {
+		remote_bitbang_quit();
+		return ERROR_FAIL;
+	}
+	buf_set_buf(remote_bitbang_xbuf, 0, tdo, 0, num_bits);
+
+	return ERROR_OK;
+}
+
+static int remote_bitbang_shift(const uint8_t *tms, const uint8_t *tdi,
+		uint8_t *tdo, unsigned num_bits)
+{
+	if (remote_bitbang_extended)
+		return remote_bitbang_shift_extended(tms, tdi, tdo, num_bits);
+	return remote_bitbang_shift_classic(tms, tdi, tdo, num_bits);
+}
+
 static int remote_bitbang_reset(int trst, int srst)
 {
 	char c = 'r' + ((trst ? 0x2 : 0x0) | (srst ? 0x1 : 0x0));
@@ -199,6 +366,7 @@ static struct bitbang_interface remote_bitbang_bitbang = {
 	.sample = &remote_bitbang_sample,
 	.read_sample = &remote_bitbang_read_sample,
 	.write = &remote_bitbang_write,
+	.shift = &remote_bitbang_shift,
 	.reset = &remote_bitbang_reset,
 	.blink = &remote_bitbang_blink,
 };
@@ -273,6 +441,38 @@ static int remote_bitbang_init_unix(void)
 	return fd;
 }
 
+/* Ask for the protocol version, followed by a plain read. Old servers
+ * ignore the unknown 'V' (possibly logging it) and only answer the read;
+ * extended servers answer 'V' and a version digit first. */
+static int remote_bitbang_probe(void)
+{
+	char c;
+
+	if (EOF == fputs("VR", remote_bitbang_file) ||
+			EOF == fflush(remote_bitbang_file)) {
+		LOG_ERROR("remote_bitbang_probe: %s", strerror(errno));
+		return ERROR_FAIL;
+	}
+
+	if (remote_bitbang_read_all(&c, 1) != ERROR_OK)
+		return ERROR_FAIL;
+	if (c == 'V') {
+		char version;
+		if (remote_bitbang_read_all(&version, 1) != ERROR_OK ||
+				remote_bitbang_read_all(&c, 1) != ERROR_OK)
+			return ERROR_FAIL;
+		remote_bitbang_extended = version >= '1';
+	}
+	if (c != '0' && c != '1') {
+		LOG_ERROR("remote_bitbang: invalid read response: %c(%i)", c, c);
+		return ERROR_FAIL;
+	}
+
+	LOG_INFO("remote_bitbang: %s protocol",
+			remote_bitbang_extended ? "extended" : "classic");
+	return ERROR_OK;
+}
+
 static int remote_bitbang_init(void)
 {
 	bitbang_interface = &remote_bitbang_bitbang;
@@ -296,6 +496,12 @@ static int remote_bitbang_init(void)
 		return ERROR_FAIL;
 	}
 
+	remote_bitbang_extended = false;
+	if (remote_bitbang_try_extended && remote_bitbang_probe() != ERROR_OK) {
+		remote_bitbang_quit();
+		return ERROR_FAIL;
+	}
+
 	LOG_INFO("remote_bitbang driver initialized");
 	return ERROR_OK;
 }
@@ -322,6 +528,14 @@ COMMAND_HANDLER(remote_bitbang_handle_remote_bitbang_host_command)
 	return ERROR_COMMAND_SYNTAX_ERROR;
 }
 
+COMMAND_HANDLER(remote_bitbang_handle_remote_bitbang_extended_command)
+{
+	if (CMD_ARGC != 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+	COMMAND_PARSE_ON_OFF(CMD_ARGV[0], remote_bitbang_try_extended);
+	return ERROR_OK;
+}
+
 static const struct command_registration remote_bitbang_command_handlers[] = {
 	{
 		.name = "remote_bitbang_port",
@@ -339,6 +553,14 @@ static const struct command_registration remote_bitbang_command_handlers[] = {
 			"  if port is 0 or unset, this is the name of the unix socket to use.",
 		.usage = "host_name",
 	},
+	{
+		.name = "remote_bitbang_extended",
+		.handler = remote_bitbang_handle_remote_bitbang_extended_command,
+		.mode = COMMAND_CONFIG,
+		.help = "Probe for and use the extended protocol with bulk "
+			"shift commands (default on).",
+		.usage = "on|off",
+	},
 	COMMAND_REGISTRATION_DONE,
 };
 
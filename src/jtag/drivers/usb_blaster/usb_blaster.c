@@ -719,7 +719,7 @@ static int ublast_scan(struct scan_command *cmd)
 	char *log_buf = NULL;
 
 	type = jtag_scan_type(cmd);
-	scan_bits = jtag_build_buffer(cmd, &buf);
+	scan_bits = jtag_build_buffer_scratch(cmd, &buf);
 
 	if (cmd->ir_scan)
 		ublast_state_move(TAP_IRSHIFT, 0);
@@ -736,8 +736,6 @@ static int ublast_scan(struct scan_command *cmd)
 	ublast_queue_tdi(buf, scan_bits, type);
 
 	ret = jtag_read_buffer(buf, cmd);
-	if (buf)
-		free(buf);
 	/*
 	 * ublast_queue_tdi sends the last bit with TMS=1. We are therefore
 	 * already in Exit1-DR/IR and have to skip the first step on our way
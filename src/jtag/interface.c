@@ -198,14 +198,106 @@ typedef const struct tms_sequences tms_table[6][6];
 
 static tms_table *tms_seqs = &short_tms_seqs;
 
+/* tms_seqs expanded to all 16x16 state pairs, indexed by the states
+ * themselves; pairs involving an unstable state have a bit_count of 0.
+ * Rebuilt whenever tms_seqs changes.
+ */
+static struct tap_tms_path tms_paths[16][16];
+static tms_table *tms_paths_source;
+
+static void tap_build_tms_paths(void)
+{
+	for (int from = 0; from < 16; from++) {
+		for (int to = 0; to < 16; to++) {
+			struct tap_tms_path *path = &tms_paths[from][to];
+
+			if (tap_is_state_stable(from) && tap_is_state_stable(to)) {
+				path->bits = (*tms_seqs)[tap_move_ndx(from)][tap_move_ndx(to)].bits;
+				path->bit_count = (*tms_seqs)[tap_move_ndx(from)][tap_move_ndx(to)].bit_count;
+			} else {
+				path->bits = 0;
+				path->bit_count = 0;
+			}
+		}
+	}
+	tms_paths_source = tms_seqs;
+}
+
+const struct tap_tms_path *tap_get_tms_path_entry(tap_state_t from, tap_state_t to)
+{
+	if (tms_paths_source != tms_seqs)
+		tap_build_tms_paths();
+
+	const struct tap_tms_path *path = &tms_paths[from & 0xf][to & 0xf];
+	if (path->bit_count == 0 || from != (from & 0xf) || to != (to & 0xf)) {
+		/* reports the unstable state and exits */
+		tap_move_ndx(from);
+		tap_move_ndx(to);
+	}
+	return path;
+}
+
 int tap_get_tms_path(tap_state_t from, tap_state_t to)
 {
-	return (*tms_seqs)[tap_move_ndx(from)][tap_move_ndx(to)].bits;
+	return tap_get_tms_path_entry(from, to)->bits;
 }
 
 int tap_get_tms_path_len(tap_state_t from, tap_state_t to)
 {
-	return (*tms_seqs)[tap_move_ndx(from)][tap_move_ndx(to)].bit_count;
+	return tap_get_tms_path_entry(from, to)->bit_count;
+}
+
+/* store the low @a count bits of @a bits at bit @a offset of @a tms */
+static void tap_put_tms_bits(uint8_t *tms, unsigned offset, unsigned bits, unsigned count)
+{
+	while (count > 0) {
+		unsigned shift = offset % 8;
+		unsigned n = MIN(8 - shift, count);
+		uint8_t mask = ((1 << n) - 1) << shift;
+
+		tms[offset / 8] = (tms[offset / 8] & ~mask) | ((bits << shift) & mask);
+		bits >>= n;
+		offset += n;
+		count -= n;
+	}
+}
+
+unsigned tap_append_tms_path(uint8_t *tms, unsigned offset,
+		tap_state_t from, tap_state_t to, unsigned skip)
+{
+	const struct tap_tms_path *path = tap_get_tms_path_entry(from, to);
+
+	if (skip >= path->bit_count)
+		return 0;
+
+	tap_put_tms_bits(tms, offset, path->bits >> skip, path->bit_count - skip);
+	return path->bit_count - skip;
+}
+
+unsigned tap_append_tms_runtest(uint8_t *tms, unsigned offset, tap_state_t from,
+		unsigned skip, unsigned num_cycles, tap_state_t to)
+{
+	unsigned start = offset;
+
+	if (from != TAP_IDLE)
+		offset += tap_append_tms_path(tms, offset, from, TAP_IDLE, skip);
+
+	/* TMS stays low while idling: fill up the current byte, then whole bytes */
+	if (num_cycles > 0 && offset % 8) {
+		unsigned n = MIN(8 - offset % 8, num_cycles);
+		tap_put_tms_bits(tms, offset, 0, n);
+		offset += n;
+		num_cycles -= n;
+	}
+	memset(&tms[offset / 8], 0, num_cycles / 8);
+	offset += num_cycles - num_cycles % 8;
+	tap_put_tms_bits(tms, offset, 0, num_cycles % 8);
+	offset += num_cycles % 8;
+
+	if (to != TAP_IDLE)
+		offset += tap_append_tms_path(tms, offset, TAP_IDLE, to, 0);
+
+	return offset - start;
 }
 
 bool tap_is_state_stable(tap_state_t astate)
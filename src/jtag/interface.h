@@ -128,6 +128,60 @@ int tap_get_tms_path(tap_state_t from, tap_state_t to);
  */
 int tap_get_tms_path_len(tap_state_t from, tap_state_t to);
 
+/**
+ * A TMS sequence moving all TAPs between two stable states, with the
+ * first bit in bit 0 of @a bits.
+ */
+struct tap_tms_path {
+	uint8_t bits;
+	uint8_t bit_count;
+};
+
+/** Upper bound for tap_tms_path.bit_count, whichever TMS table is in use. */
+#define TAP_TMS_PATH_MAX_BITS	7
+
+/**
+ * Looks up the precomputed TMS sequence from stable state @a from to stable
+ * state @a to. This is what tap_get_tms_path() and tap_get_tms_path_len()
+ * return, but in one table access, so drivers should prefer it on hot paths.
+ *
+ * @param from The starting state.
+ * @param to The desired final state.
+ * @return The path, valid until tap_use_new_tms_table() is called.
+ */
+const struct tap_tms_path *tap_get_tms_path_entry(tap_state_t from, tap_state_t to);
+
+/**
+ * Stores the TMS sequence from @a from to @a to into the packed bit buffer
+ * @a tms, starting at bit @a offset.
+ *
+ * @param skip Number of leading bits of the path to leave out, typically 1
+ * when the last bit of a scan already clocked TMS high to leave a shift state.
+ * @return The number of bits stored.
+ */
+unsigned tap_append_tms_path(uint8_t *tms, unsigned offset,
+		tap_state_t from, tap_state_t to, unsigned skip);
+
+/**
+ * Stores into @a tms, starting at bit @a offset, the complete TMS sequence of
+ * a runtest: the move from @a from to Run-Test/Idle (less its first @a skip
+ * bits), @a num_cycles clocks in Run-Test/Idle and the move on to @a to. The
+ * moves are left out when @a from or @a to is TAP_IDLE itself.
+ *
+ * Passing a shift state as @a from with @a skip 1 and a shift state as @a to
+ * builds the "exit shift, idle, enter shift" sequence between two scans as
+ * a single bit stream.
+ *
+ * @return The number of bits stored; at most @a num_cycles plus twice
+ * TAP_TMS_PATH_MAX_BITS.
+ */
+unsigned tap_append_tms_runtest(uint8_t *tms, unsigned offset, tap_state_t from,
+		unsigned skip, unsigned num_cycles, tap_state_t to);
+
+/** Size of a buffer holding any tap_append_tms_runtest() result at offset 0. */
+#define TAP_TMS_RUNTEST_BYTES(num_cycles) \
+	DIV_ROUND_UP(2 * TAP_TMS_PATH_MAX_BITS + (num_cycles), 8)
+
 
 /**
  * Function tap_move_ndx
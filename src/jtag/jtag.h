@@ -295,6 +295,19 @@ void jtag_set_verify_capture_ir(bool enable);
 /** @returns True if IR scan verification will be performed. */
 bool jtag_will_verify_capture_ir(void);
 
+/**
+ * Enable or disable skipping of IR scans that would load the instructions
+ * all TAPs already hold, as recorded in their cur_instr and bypass fields.
+ */
+void jtag_set_ir_cache(bool enable);
+/** @returns True if redundant IR scans are skipped. */
+bool jtag_will_cache_ir(void);
+/**
+ * Forget which instructions the TAPs hold, so the next IR scan is always
+ * performed. Call this after changing the IRs behind the core's back.
+ */
+void jtag_ir_cache_invalidate(void);
+
 /** Initialize debug adapter upon startup.  */
 int adapter_init(struct command_context *cmd_ctx);
 
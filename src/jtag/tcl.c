@@ -646,6 +646,7 @@ static void jtag_tap_handle_event(struct jtag_tap *tap, enum jtag_event e)
 				 * really be verifying the scan chains ...
 				 */
 			    tap->enabled = (e == JTAG_TAP_EVENT_ENABLE);
+			    jtag_ir_cache_invalidate();
 			    LOG_INFO("JTAG tap: %s %s", tap->dotted_name,
 				tap->enabled ? "enabled" : "disabled");
 			    break;
@@ -832,6 +833,41 @@ COMMAND_HANDLER(handle_jtag_init_command)
 	return jtag_init(CMD_CTX);
 }
 
+static int jim_jtag_queue_stats(Jim_Interp *interp, int argc, Jim_Obj *const *argv)
+{
+	if (argc > 2 || (argc == 2 && strcmp(Jim_String(argv[1]), "reset") != 0)) {
+		Jim_WrongNumArgs(interp, 1, argv, "['reset']");
+		return JIM_ERR;
+	}
+	if (argc == 2) {
+		jtag_command_queue_reset_stats();
+		return JIM_OK;
+	}
+
+	const struct jtag_command_queue_stats *stats = jtag_command_queue_get_stats();
+	int64_t elapsed = timeval_ms() - stats->since;
+	uint64_t per_flush = stats->flushes ? stats->commands / stats->flushes : 0;
+	uint64_t per_sec = elapsed > 0 ? stats->flushes * 1000 / elapsed : 0;
+
+	/* key/value pairs, usable with dict get */
+	char *str = alloc_printf("flushes %" PRIu64 " flushes_per_sec %" PRIu64
+			" commands %" PRIu64 " commands_per_flush %" PRIu64
+			" last_commands %u max_commands %u bytes %" PRIu64
+			" page_allocs %" PRIu64 " page_reuses %" PRIu64 " pool_pages %u"
+			" ir_scans %" PRIu64 " ir_scans_elided %" PRIu64
+			" dr_scans %" PRIu64 " dr_bypass_bits %" PRIu64,
+			stats->flushes, per_sec, stats->commands, per_flush,
+			stats->last_commands, stats->max_commands, stats->bytes,
+			stats->page_allocs, stats->page_reuses, stats->pool_pages,
+			stats->ir_scans, stats->ir_scans_elided,
+			stats->dr_scans, stats->dr_bypass_bits);
+	if (!str)
+		return JIM_ERR;
+	Jim_SetResult(interp, Jim_NewStringObj(interp, str, -1));
+	free(str);
+	return JIM_OK;
+}
+
 static const struct command_registration jtag_subcommand_handlers[] = {
 	{
 		.name = "init",
@@ -908,6 +944,14 @@ static const struct command_registration jtag_subcommand_handlers[] = {
 			"TAP event.",
 		.usage = "tap_name '-event' event_name",
 	},
+	{
+		.name = "queue_stats",
+		.mode = COMMAND_EXEC,
+		.jim_handler = jim_jtag_queue_stats,
+		.help = "Returns command queue counters as key/value pairs, "
+			"or clears them.",
+		.usage = "['reset']",
+	},
 	{
 		.name = "names",
 		.mode = COMMAND_ANY,
@@ -1181,6 +1225,23 @@ COMMAND_HANDLER(handle_verify_ircapture_command)
 	return ERROR_OK;
 }
 
+COMMAND_HANDLER(handle_ir_cache_command)
+{
+	if (CMD_ARGC > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (CMD_ARGC == 1) {
+		bool enable;
+		COMMAND_PARSE_ENABLE(CMD_ARGV[0], enable);
+		jtag_set_ir_cache(enable);
+	}
+
+	const char *status = jtag_will_cache_ir() ? "enabled" : "disabled";
+	command_print(CMD_CTX, "IR cache is %s", status);
+
+	return ERROR_OK;
+}
+
 COMMAND_HANDLER(handle_verify_jtag_command)
 {
 	if (CMD_ARGC > 1)
@@ -1341,6 +1402,14 @@ static const struct command_registration jtag_command_handlers[] = {
 			"verify values captured during Capture-IR.",
 		.usage = "['enable'|'disable']",
 	},
+	{
+		.name = "ir_cache",
+		.handler = handle_ir_cache_command,
+		.mode = COMMAND_ANY,
+		.help = "Display or assign flag controlling whether IR scans "
+			"loading the instructions the TAPs already hold are skipped.",
+		.usage = "['enable'|'disable']",
+	},
 	{
 		.name = "verify_jtag",
 		.handler = handle_verify_jtag_command,
@@ -33,6 +33,8 @@
 #include "openocd.h"
 #include "tcl_server.h"
 #include "telnet_server.h"
+#include "watch_server.h"
+#include "trace_server.h"
 
 #include <signal.h>
 
@@ -679,6 +681,20 @@ int server_init(struct command_context *cmd_ctx)
 		return ret;
 	}
 
+	ret = watch_init();
+
+	if (ret != ERROR_OK) {
+		remove_services();
+		return ret;
+	}
+
+	ret = trace_server_init();
+
+	if (ret != ERROR_OK) {
+		remove_services();
+		return ret;
+	}
+
 	return ERROR_OK;
 }
 
@@ -702,6 +718,8 @@ void server_free(void)
 {
 	tcl_service_free();
 	telnet_service_free();
+	watch_service_free();
+	trace_service_free();
 	jsp_service_free();
 }
 
@@ -819,6 +837,14 @@ int server_register_commands(struct command_context *cmd_ctx)
 	if (ERROR_OK != retval)
 		return retval;
 
+	retval = watch_register_commands(cmd_ctx);
+	if (ERROR_OK != retval)
+		return retval;
+
+	retval = trace_server_register_commands(cmd_ctx);
+	if (ERROR_OK != retval)
+		return retval;
+
 	return register_commands(cmd_ctx, NULL, server_command_handlers);
 }
 
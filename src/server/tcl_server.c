@@ -28,6 +28,11 @@
 #define TCL_LINE_INITIAL		(4*1024)
 #define TCL_LINE_MAX			(4*1024*1024)
 
+/* binary framing: status byte of a reply */
+#define TCL_BINARY_OK			0x00
+#define TCL_BINARY_ERROR		0x01
+#define TCL_BINARY_NOTIFY		0xff
+
 struct tcl_connection {
 	int tc_linedrop;
 	int tc_lineoffset;
@@ -37,6 +42,9 @@ struct tcl_connection {
 	enum target_state tc_laststate;
 	bool tc_notify;
 	bool tc_trace;
+	bool tc_binary;			/* length prefixed framing in use */
+	bool tc_binary_next;	/* framing after the current reply */
+	uint32_t tc_skip;		/* bytes left of an oversized binary request */
 };
 
 static char *tcl_port;
@@ -47,6 +55,41 @@ static int tcl_input(struct connection *connection);
 static int tcl_output(struct connection *connection, const void *buf, ssize_t len);
 static int tcl_closed(struct connection *connection);
 
+/* send an asynchronous message; text mode terminates it with ctrl-z,
+ * binary mode sends it as a reply frame with the notification status */
+static void tcl_notify(struct connection *connection, const char *msg,
+		const uint8_t *data, size_t len)
+{
+	struct tcl_connection *tclc = connection->priv;
+	size_t msg_len = strlen(msg);
+	uint8_t header[5];
+
+	if (tclc->tc_binary) {
+		h_u32_to_le(header, msg_len + len);
+		header[4] = TCL_BINARY_NOTIFY;
+		if (tcl_output(connection, header, sizeof(header)) != ERROR_OK)
+			return;
+		if (tcl_output(connection, msg, msg_len) != ERROR_OK)
+			return;
+		if (len)
+			tcl_output(connection, data, len);
+		return;
+	}
+
+	if (tcl_output(connection, msg, msg_len) != ERROR_OK)
+		return;
+	if (len) {
+		size_t hex_len = len * 2 + 1;
+		char *hex = malloc(hex_len);
+		if (hex == NULL)
+			return;
+		hexify(hex, data, len, hex_len);
+		tcl_output(connection, hex, strlen(hex));
+		free(hex);
+	}
+	tcl_output(connection, "\r\n\x1a", 3);
+}
+
 static int tcl_target_callback_event_handler(struct target *target,
 		enum target_event event, void *priv)
 {
@@ -57,15 +100,15 @@ static int tcl_target_callback_event_handler(struct target *target,
 	tclc = connection->priv;
 
 	if (tclc->tc_notify) {
-		snprintf(buf, sizeof(buf), "type target_event event %s\r\n\x1a", target_event_name(event));
-		tcl_output(connection, buf, strlen(buf));
+		snprintf(buf, sizeof(buf), "type target_event event %s", target_event_name(event));
+		tcl_notify(connection, buf, NULL, 0);
 	}
 
 	if (tclc->tc_laststate != target->state) {
 		tclc->tc_laststate = target->state;
 		if (tclc->tc_notify) {
-			snprintf(buf, sizeof(buf), "type target_state state %s\r\n\x1a", target_state_name(target));
-			tcl_output(connection, buf, strlen(buf));
+			snprintf(buf, sizeof(buf), "type target_state state %s", target_state_name(target));
+			tcl_notify(connection, buf, NULL, 0);
 		}
 	}
 
@@ -82,8 +125,8 @@ static int tcl_target_callback_reset_handler(struct target *target,
 	tclc = connection->priv;
 
 	if (tclc->tc_notify) {
-		snprintf(buf, sizeof(buf), "type target_reset mode %s\r\n\x1a", target_reset_mode_name(reset_mode));
-		tcl_output(connection, buf, strlen(buf));
+		snprintf(buf, sizeof(buf), "type target_reset mode %s", target_reset_mode_name(reset_mode));
+		tcl_notify(connection, buf, NULL, 0);
 	}
 
 	return ERROR_OK;
@@ -94,23 +137,12 @@ static int tcl_target_callback_trace_handler(struct target *target,
 {
 	struct connection *connection = priv;
 	struct tcl_connection *tclc;
-	char *header = "type target_trace data ";
-	char *trailer = "\r\n\x1a";
-	size_t hex_len = len * 2 + 1;
-	size_t max_len = hex_len + strlen(header) + strlen(trailer);
-	char *buf, *hex;
 
 	tclc = connection->priv;
 
-	if (tclc->tc_trace) {
-		hex = malloc(hex_len);
-		buf = malloc(max_len);
-		hexify(hex, data, len, hex_len);
-		snprintf(buf, max_len, "%s%s%s", header, hex, trailer);
-		tcl_output(connection, buf, strlen(buf));
-		free(hex);
-		free(buf);
-	}
+	/* hex encoded in text mode, raw bytes in binary mode */
+	if (tclc->tc_trace)
+		tcl_notify(connection, "type target_trace data ", data, len);
 
 	return ERROR_OK;
 }
@@ -171,30 +203,21 @@ static int tcl_new_connection(struct connection *connection)
 	return ERROR_OK;
 }
 
-static int tcl_input(struct connection *connection)
+static int tcl_input_binary(struct connection *connection,
+		const unsigned char *in, ssize_t len);
+
+static int tcl_input_text(struct connection *connection,
+		const unsigned char *in, ssize_t rlen)
 {
 	Jim_Interp *interp = (Jim_Interp *)connection->cmd_ctx->interp;
+	struct tcl_connection *tclc = connection->priv;
 	int retval;
 	int i;
-	ssize_t rlen;
 	const char *result;
 	int reslen;
-	struct tcl_connection *tclc;
-	unsigned char in[256];
 	char *tc_line_new;
 	int tc_line_size_new;
 
-	rlen = connection_read(connection, &in, sizeof(in));
-	if (rlen <= 0) {
-		if (rlen < 0)
-			LOG_ERROR("error during read: %s", strerror(errno));
-		return ERROR_SERVER_REMOTE_CLOSED;
-	}
-
-	tclc = connection->priv;
-	if (tclc == NULL)
-		return ERROR_CONNECTION_REJECTED;
-
 	/* push as much data into the line as possible */
 	for (i = 0; i < rlen; i++) {
 		/* buffer the data */
@@ -252,11 +275,177 @@ static int tcl_input(struct connection *connection)
 
 		tclc->tc_lineoffset = 0;
 		tclc->tc_linedrop = 0;
+
+		/* tcl_framing takes effect once its reply is out */
+		if (tclc->tc_binary_next) {
+			tclc->tc_binary = true;
+			return tcl_input_binary(connection, in + i + 1, rlen - i - 1);
+		}
+	}
+
+	return ERROR_OK;
+}
+
+static int tcl_binary_reply(struct connection *connection, uint8_t status,
+		const char *payload, uint32_t len)
+{
+	uint8_t header[5];
+
+	h_u32_to_le(header, len);
+	header[4] = status;
+	int retval = tcl_output(connection, header, sizeof(header));
+	if (retval != ERROR_OK || len == 0)
+		return retval;
+	return tcl_output(connection, payload, len);
+}
+
+/* A binary request is a list of words, each one a little endian u32 length
+ * followed by that many bytes. The words are handed to the interpreter
+ * as they are, so no quoting is needed and binary data survives. */
+static int tcl_run_binary_request(struct connection *connection,
+		const uint8_t *req, uint32_t len)
+{
+	Jim_Interp *interp = (Jim_Interp *)connection->cmd_ctx->interp;
+	uint32_t pos;
+	int objc = 0;
+
+	for (pos = 0; pos < len; objc++) {
+		uint32_t word_len = 0;
+		if (len - pos >= 4)
+			word_len = le_to_h_u32(req + pos);
+		if (len - pos < 4 || word_len > len - pos - 4) {
+#define ESTR "malformed request"
+			return tcl_binary_reply(connection, TCL_BINARY_ERROR, ESTR, strlen(ESTR));
+#undef ESTR
+		}
+		pos += 4 + word_len;
+	}
+	if (objc == 0)
+		return tcl_binary_reply(connection, TCL_BINARY_OK, NULL, 0);
+
+	Jim_Obj **objv = malloc(objc * sizeof(*objv));
+	if (objv == NULL)
+		return ERROR_FAIL;
+
+	pos = 0;
+	for (int i = 0; i < objc; i++) {
+		uint32_t word_len = le_to_h_u32(req + pos);
+		objv[i] = Jim_NewStringObj(interp, (const char *)req + pos + 4, word_len);
+		Jim_IncrRefCount(objv[i]);
+		pos += 4 + word_len;
+	}
+
+	int retval = command_run_objv(connection->cmd_ctx, objc, objv);
+
+	for (int i = 0; i < objc; i++)
+		Jim_DecrRefCount(interp, objv[i]);
+	free(objv);
+
+	int reslen;
+	const char *result = Jim_GetString(Jim_GetResult(interp), &reslen);
+	return tcl_binary_reply(connection,
+			retval == ERROR_OK ? TCL_BINARY_OK : TCL_BINARY_ERROR,
+			result, reslen);
+}
+
+static int tcl_input_binary(struct connection *connection,
+		const unsigned char *in, ssize_t len)
+{
+	struct tcl_connection *tclc = connection->priv;
+	int retval;
+
+	while (len > 0) {
+		uint32_t n;
+
+		if (tclc->tc_skip) {
+			/* oversized request, throw it away */
+			n = MIN((uint32_t)len, tclc->tc_skip);
+			tclc->tc_skip -= n;
+			in += n;
+			len -= n;
+			if (tclc->tc_skip == 0) {
+#define ESTR "request too long"
+				retval = tcl_binary_reply(connection, TCL_BINARY_ERROR, ESTR, strlen(ESTR));
+				if (retval != ERROR_OK)
+					return retval;
+#undef ESTR
+			}
+			continue;
+		}
+
+		/* length prefix */
+		if (tclc->tc_lineoffset < 4) {
+			n = MIN((uint32_t)len, 4u - tclc->tc_lineoffset);
+			memcpy(tclc->tc_line + tclc->tc_lineoffset, in, n);
+			tclc->tc_lineoffset += n;
+			in += n;
+			len -= n;
+			/* a complete prefix may already be a complete request */
+			if (tclc->tc_lineoffset < 4)
+				continue;
+		}
+
+		uint32_t req_len = le_to_h_u32((uint8_t *)tclc->tc_line);
+		if (req_len > TCL_LINE_MAX - 4) {
+			tclc->tc_skip = req_len;
+			tclc->tc_lineoffset = 0;
+			continue;
+		}
+
+		/* the length is known up front, grow the buffer once */
+		if ((uint32_t)tclc->tc_line_size < 4 + req_len) {
+			char *tc_line_new = realloc(tclc->tc_line, 4 + req_len);
+			if (tc_line_new == NULL)
+				return ERROR_FAIL;
+			tclc->tc_line = tc_line_new;
+			tclc->tc_line_size = 4 + req_len;
+		}
+
+		n = MIN((uint32_t)len, 4 + req_len - tclc->tc_lineoffset);
+		memcpy(tclc->tc_line + tclc->tc_lineoffset, in, n);
+		tclc->tc_lineoffset += n;
+		in += n;
+		len -= n;
+
+		if ((uint32_t)tclc->tc_lineoffset < 4 + req_len)
+			continue;
+
+		tclc->tc_lineoffset = 0;
+		retval = tcl_run_binary_request(connection, (uint8_t *)tclc->tc_line + 4, req_len);
+		if (retval != ERROR_OK)
+			return retval;
+
+		if (!tclc->tc_binary_next) {
+			tclc->tc_binary = false;
+			return tcl_input_text(connection, in, len);
+		}
 	}
 
 	return ERROR_OK;
 }
 
+static int tcl_input(struct connection *connection)
+{
+	ssize_t rlen;
+	struct tcl_connection *tclc;
+	unsigned char in[4096];
+
+	rlen = connection_read(connection, &in, sizeof(in));
+	if (rlen <= 0) {
+		if (rlen < 0)
+			LOG_ERROR("error during read: %s", strerror(errno));
+		return ERROR_SERVER_REMOTE_CLOSED;
+	}
+
+	tclc = connection->priv;
+	if (tclc == NULL)
+		return ERROR_CONNECTION_REJECTED;
+
+	if (tclc->tc_binary)
+		return tcl_input_binary(connection, in, rlen);
+	return tcl_input_text(connection, in, rlen);
+}
+
 static int tcl_closed(struct connection *connection)
 {
 	struct tcl_connection *tclc;
@@ -327,6 +516,36 @@ COMMAND_HANDLER(handle_tcl_trace_command)
 	}
 }
 
+COMMAND_HANDLER(handle_tcl_framing_command)
+{
+	struct connection *connection = NULL;
+	struct tcl_connection *tclc = NULL;
+
+	if (CMD_CTX->output_handler_priv != NULL)
+		connection = CMD_CTX->output_handler_priv;
+
+	if (connection == NULL || strcmp(connection->service->name, "tcl")) {
+		LOG_ERROR("%s: can only be called from the tcl server", CMD_NAME);
+		return ERROR_COMMAND_SYNTAX_ERROR;
+	}
+	tclc = connection->priv;
+
+	if (CMD_ARGC > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (CMD_ARGC == 1) {
+		if (strcmp(CMD_ARGV[0], "binary") == 0)
+			tclc->tc_binary_next = true;
+		else if (strcmp(CMD_ARGV[0], "text") == 0)
+			tclc->tc_binary_next = false;
+		else
+			return ERROR_COMMAND_SYNTAX_ERROR;
+	}
+
+	command_print(CMD_CTX, "%s", tclc->tc_binary_next ? "binary" : "text");
+	return ERROR_OK;
+}
+
 static const struct command_registration tcl_command_handlers[] = {
 	{
 		.name = "tcl_port",
@@ -344,6 +563,14 @@ static const struct command_registration tcl_command_handlers[] = {
 		.help = "Target Notification output",
 		.usage = "[on|off]",
 	},
+	{
+		.name = "tcl_framing",
+		.handler = handle_tcl_framing_command,
+		.mode = COMMAND_EXEC,
+		.help = "Select text (ctrl-z terminated) or binary "
+			"(length prefixed) requests and replies",
+		.usage = "[text|binary]",
+	},
 	{
 		.name = "tcl_trace",
 		.handler = handle_tcl_trace_command,
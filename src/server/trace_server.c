@@ -0,0 +1,372 @@
+/***************************************************************************
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+/**
+ * @file
+ * Decoded ITM/DWT trace service. Trace data gathered by the adapter
+ * (see "tpiu config internal") is decoded on the fly and the packets of
+ * the channels a client subscribed to are pushed to it.
+ *
+ * Requests are text lines:
+ *   subscribe <channel>...
+ *   unsubscribe <channel>...
+ * where a channel is a stimulus port number, a port range "first-last",
+ * "pc", "exception", "dwt", "timestamp", "overflow" or "all".
+ * Everything sent back is a binary frame, little endian:
+ *   u8 type, u16 id, u32 timestamp (ms since connect), u16 length, payload
+ * A TRACE_FRAME_REPLY answers each request with "OK" or "ERROR <reason>".
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "trace_server.h"
+#include <target/target.h>
+#include <target/armv7m_itm.h>
+#include <helper/time_support.h>
+
+#define TRACE_LINE_MAX		256
+#define TRACE_OUT_SIZE		8192
+#define TRACE_NUM_PORTS		256
+
+/* subscriptions besides the stimulus ports */
+#define TRACE_CH_PC			(1 << 0)
+#define TRACE_CH_EXCEPTION	(1 << 1)
+#define TRACE_CH_DWT		(1 << 2)
+#define TRACE_CH_TIMESTAMP	(1 << 3)
+#define TRACE_CH_OVERFLOW	(1 << 4)
+#define TRACE_CH_ALL		0x1f
+
+struct trace_connection {
+	char line[TRACE_LINE_MAX];
+	unsigned line_len;
+	bool line_drop;
+	int64_t start_ms;
+	bool outerror;
+
+	uint32_t ports[TRACE_NUM_PORTS / 32];
+	unsigned channels;
+	struct itm_decoder decoder;
+
+	/* frames are collected and sent once per chunk of trace data */
+	uint8_t out[TRACE_OUT_SIZE];
+	unsigned out_len;
+	uint32_t now;
+};
+
+static const struct {
+	const char *name;
+	unsigned channel;
+} trace_channels[] = {
+	{ "pc", TRACE_CH_PC },
+	{ "exception", TRACE_CH_EXCEPTION },
+	{ "dwt", TRACE_CH_DWT },
+	{ "timestamp", TRACE_CH_TIMESTAMP },
+	{ "overflow", TRACE_CH_OVERFLOW },
+};
+
+static char *trace_server_port;
+
+static int trace_flush(struct connection *connection)
+{
+	struct trace_connection *tc = connection->priv;
+
+	if (tc->outerror)
+		return ERROR_SERVER_REMOTE_CLOSED;
+
+	if (tc->out_len && connection_write(connection, tc->out, tc->out_len)
+			!= (int)tc->out_len) {
+		LOG_ERROR("trace: error during write");
+		tc->outerror = true;
+		return ERROR_SERVER_REMOTE_CLOSED;
+	}
+	tc->out_len = 0;
+
+	return ERROR_OK;
+}
+
+static void trace_queue(struct connection *connection, uint8_t type,
+		uint16_t id, const void *data, uint16_t len)
+{
+	struct trace_connection *tc = connection->priv;
+	uint8_t *p;
+
+	if (tc->out_len + TRACE_FRAME_HEADER_SIZE + len > sizeof(tc->out)
+			&& trace_flush(connection) != ERROR_OK)
+		return;
+
+	p = tc->out + tc->out_len;
+	p[0] = type;
+	h_u16_to_le(p + 1, id);
+	h_u32_to_le(p + 3, tc->now);
+	h_u16_to_le(p + 7, len);
+	if (len)
+		memcpy(p + TRACE_FRAME_HEADER_SIZE, data, len);
+	tc->out_len += TRACE_FRAME_HEADER_SIZE + len;
+}
+
+static int trace_reply(struct connection *connection, const char *msg)
+{
+	struct trace_connection *tc = connection->priv;
+
+	tc->now = (uint32_t)(timeval_ms() - tc->start_ms);
+	trace_queue(connection, TRACE_FRAME_REPLY, 0, msg, strlen(msg));
+	return trace_flush(connection);
+}
+
+static void trace_packet(const struct itm_packet *packet, void *priv)
+{
+	struct connection *connection = priv;
+	struct trace_connection *tc = connection->priv;
+	uint8_t payload[4];
+	uint8_t function;
+
+	h_u32_to_le(payload, packet->value);
+
+	switch (packet->type) {
+	case ITM_PACKET_SWIT:
+		if (tc->ports[packet->id / 32] & (1u << (packet->id % 32)))
+			trace_queue(connection, TRACE_FRAME_STIMULUS, packet->id,
+					payload, packet->size);
+		break;
+	case ITM_PACKET_HW:
+		if (packet->id == ITM_HW_PC_SAMPLE) {
+			/* a one byte sample means the core was sleeping */
+			if (tc->channels & TRACE_CH_PC)
+				trace_queue(connection, TRACE_FRAME_PC_SAMPLE, 0,
+						payload, packet->size == 4 ? 4 : 0);
+		} else if (packet->id == ITM_HW_EXCEPTION) {
+			function = (packet->value >> 12) & 3;
+			if (tc->channels & TRACE_CH_EXCEPTION)
+				trace_queue(connection, TRACE_FRAME_EXCEPTION,
+						packet->value & 0x1ff, &function, 1);
+		} else if (tc->channels & TRACE_CH_DWT) {
+			trace_queue(connection, TRACE_FRAME_DWT, packet->id,
+					payload, packet->size);
+		}
+		break;
+	case ITM_PACKET_TIMESTAMP:
+		if (tc->channels & TRACE_CH_TIMESTAMP)
+			trace_queue(connection, TRACE_FRAME_TIMESTAMP, packet->id,
+					payload, 4);
+		break;
+	case ITM_PACKET_OVERFLOW:
+		if (tc->channels & TRACE_CH_OVERFLOW)
+			trace_queue(connection, TRACE_FRAME_OVERFLOW, 0, NULL, 0);
+		break;
+	default:
+		break;
+	}
+}
+
+static int trace_data(struct target *target, size_t len, uint8_t *data,
+		void *priv)
+{
+	struct connection *connection = priv;
+	struct trace_connection *tc = connection->priv;
+
+	/* decode everything, even unsubscribed, to stay in step with packets */
+	tc->now = (uint32_t)(timeval_ms() - tc->start_ms);
+	itm_decode(&tc->decoder, data, len);
+
+	return trace_flush(connection);
+}
+
+static int trace_subscribe(struct connection *connection, char **argv,
+		unsigned argc, bool subscribe)
+{
+	struct trace_connection *tc = connection->priv;
+	uint32_t ports[ARRAY_SIZE(tc->ports)] = { 0 };
+	unsigned channels = 0;
+
+	if (argc < 2)
+		return trace_reply(connection, "ERROR syntax: (un)subscribe <channel>...");
+
+	for (unsigned i = 1; i < argc; i++) {
+		unsigned first, last, j;
+		char *dash;
+
+		for (j = 0; j < ARRAY_SIZE(trace_channels); j++) {
+			if (strcmp(argv[i], trace_channels[j].name) == 0)
+				break;
+		}
+		if (j < ARRAY_SIZE(trace_channels)) {
+			channels |= trace_channels[j].channel;
+			continue;
+		}
+
+		if (strcmp(argv[i], "all") == 0) {
+			channels |= TRACE_CH_ALL;
+			memset(ports, 0xff, sizeof(ports));
+			continue;
+		}
+
+		dash = strchr(argv[i], '-');
+		if (dash)
+			*dash = '\0';
+		if (parse_uint(argv[i], &first) != ERROR_OK
+				|| (dash && parse_uint(dash + 1, &last) != ERROR_OK))
+			return trace_reply(connection, "ERROR unknown channel");
+		if (!dash)
+			last = first;
+		if (first > last || last >= TRACE_NUM_PORTS)
+			return trace_reply(connection, "ERROR invalid port");
+
+		for (unsigned port = first; port <= last; port++)
+			ports[port / 32] |= 1u << (port % 32);
+	}
+
+	for (unsigned i = 0; i < ARRAY_SIZE(ports); i++) {
+		if (subscribe)
+			tc->ports[i] |= ports[i];
+		else
+			tc->ports[i] &= ~ports[i];
+	}
+	if (subscribe)
+		tc->channels |= channels;
+	else
+		tc->channels &= ~channels;
+
+	return trace_reply(connection, "OK");
+}
+
+static int trace_request(struct connection *connection, char *line)
+{
+	char *argv[TRACE_LINE_MAX / 2];
+	unsigned argc = 0;
+
+	for (char *tok = strtok(line, " \t\r"); tok && argc < ARRAY_SIZE(argv);
+			tok = strtok(NULL, " \t\r"))
+		argv[argc++] = tok;
+
+	if (argc == 0)
+		return ERROR_OK;
+
+	if (strcmp(argv[0], "subscribe") == 0)
+		return trace_subscribe(connection, argv, argc, true);
+
+	if (strcmp(argv[0], "unsubscribe") == 0)
+		return trace_subscribe(connection, argv, argc, false);
+
+	return trace_reply(connection, "ERROR unknown request");
+}
+
+static int trace_new_connection(struct connection *connection)
+{
+	struct trace_connection *tc;
+
+	tc = calloc(1, sizeof(struct trace_connection));
+	if (tc == NULL)
+		return ERROR_CONNECTION_REJECTED;
+
+	tc->start_ms = timeval_ms();
+	itm_decoder_init(&tc->decoder, trace_packet, connection);
+	connection->priv = tc;
+
+	target_register_trace_callback(trace_data, connection);
+
+	return ERROR_OK;
+}
+
+static int trace_input(struct connection *connection)
+{
+	struct trace_connection *tc = connection->priv;
+	char in[256];
+	ssize_t rlen;
+	int retval;
+
+	rlen = connection_read(connection, in, sizeof(in));
+	if (rlen <= 0) {
+		if (rlen < 0)
+			LOG_ERROR("error during read: %s", strerror(errno));
+		return ERROR_SERVER_REMOTE_CLOSED;
+	}
+
+	for (ssize_t i = 0; i < rlen; i++) {
+		if (in[i] != '\n') {
+			if (tc->line_len < sizeof(tc->line) - 1)
+				tc->line[tc->line_len++] = in[i];
+			else
+				tc->line_drop = true;
+			continue;
+		}
+
+		if (tc->line_drop) {
+			retval = trace_reply(connection, "ERROR line too long");
+		} else {
+			tc->line[tc->line_len] = '\0';
+			retval = trace_request(connection, tc->line);
+		}
+		if (retval != ERROR_OK)
+			return retval;
+
+		tc->line_len = 0;
+		tc->line_drop = false;
+	}
+
+	return tc->outerror ? ERROR_SERVER_REMOTE_CLOSED : ERROR_OK;
+}
+
+static int trace_closed(struct connection *connection)
+{
+	target_unregister_trace_callback(trace_data, connection);
+
+	free(connection->priv);
+	connection->priv = NULL;
+
+	return ERROR_OK;
+}
+
+int trace_server_init(void)
+{
+	if (strcmp(trace_server_port, "disabled") == 0) {
+		LOG_INFO("trace server disabled");
+		return ERROR_OK;
+	}
+
+	return add_service("trace", trace_server_port, CONNECTION_LIMIT_UNLIMITED,
+		&trace_new_connection, &trace_input,
+		&trace_closed, NULL);
+}
+
+COMMAND_HANDLER(handle_trace_port_command)
+{
+	return CALL_COMMAND_HANDLER(server_pipe_command, &trace_server_port);
+}
+
+static const struct command_registration trace_server_command_handlers[] = {
+	{
+		.name = "trace_port",
+		.handler = handle_trace_port_command,
+		.mode = COMMAND_ANY,
+		.help = "Specify port on which to listen "
+			"for decoded ITM/DWT trace clients.  "
+			"Read help on 'gdb_port'.",
+		.usage = "[port_num]",
+	},
+	COMMAND_REGISTRATION_DONE
+};
+
+int trace_server_register_commands(struct command_context *cmd_ctx)
+{
+	trace_server_port = strdup("disabled");
+	return register_commands(cmd_ctx, NULL, trace_server_command_handlers);
+}
+
+void trace_service_free(void)
+{
+	free(trace_server_port);
+}
@@ -0,0 +1,37 @@
+/***************************************************************************
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+#ifndef OPENOCD_SERVER_TRACE_SERVER_H
+#define OPENOCD_SERVER_TRACE_SERVER_H
+
+#include <server/server.h>
+
+/* frame types sent to trace clients */
+#define TRACE_FRAME_STIMULUS	0x01	/* id: port, payload: written value */
+#define TRACE_FRAME_PC_SAMPLE	0x02	/* payload: PC, empty while asleep */
+#define TRACE_FRAME_EXCEPTION	0x03	/* id: exception, payload: function */
+#define TRACE_FRAME_DWT			0x04	/* id: discriminator, payload: value */
+#define TRACE_FRAME_TIMESTAMP	0x05	/* id: TC field, payload: u32 delta */
+#define TRACE_FRAME_OVERFLOW	0x06	/* payload: empty */
+#define TRACE_FRAME_REPLY		0x07	/* payload: reply text to a request */
+
+/* type, id (u16), timestamp in ms (u32), payload length (u16) */
+#define TRACE_FRAME_HEADER_SIZE	9
+
+int trace_server_init(void);
+int trace_server_register_commands(struct command_context *cmd_ctx);
+void trace_service_free(void);
+
+#endif /* OPENOCD_SERVER_TRACE_SERVER_H */
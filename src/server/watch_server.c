@@ -0,0 +1,408 @@
+/***************************************************************************
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+/**
+ * @file
+ * Live memory watch service. Clients subscribe to memory ranges with a
+ * sampling period and get the sampled contents pushed to them, without
+ * halting the target and without going through the Tcl interpreter.
+ *
+ * Requests are text lines:
+ *   add <id> <address> <size> <period_ms>
+ *   remove <id>
+ *   clear
+ * Everything sent back is a binary frame, little endian:
+ *   u8 type, u16 id, u32 timestamp (ms since connect), u16 length, payload
+ * A WATCH_FRAME_REPLY answers each request with "OK" or "ERROR <reason>".
+ *
+ * On every tick all due subscriptions of all clients are sorted by
+ * address and ranges that touch or overlap are fetched with one target
+ * read. Gaps are never read: a watched register may sit next to one
+ * whose read has side effects, such as a FIFO or a UART data register.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "watch_server.h"
+#include <target/target.h>
+#include <helper/list.h>
+#include <helper/time_support.h>
+
+#define WATCH_LINE_MAX			256
+#define WATCH_MAX_SIZE			1024	/* bytes per subscription */
+#define WATCH_MIN_PERIOD		1		/* ms */
+#define WATCH_MAX_BATCH			4096	/* bytes per merged read */
+
+struct watch_connection {
+	char line[WATCH_LINE_MAX];
+	unsigned line_len;
+	bool line_drop;
+	int64_t start_ms;
+	bool outerror;
+};
+
+struct watch_subscription {
+	struct list_head lh;
+	struct connection *connection;
+	uint16_t id;
+	struct target *target;
+	target_addr_t address;
+	uint32_t size;
+	unsigned period_ms;
+	int64_t next_due;
+};
+
+static char *watch_port;
+
+/* subscriptions of all connections, so reads can be shared */
+static LIST_HEAD(watch_subscriptions);
+
+static int watch_send(struct connection *connection, uint8_t type,
+		uint16_t id, const void *data, uint16_t len)
+{
+	struct watch_connection *wc = connection->priv;
+	uint8_t header[WATCH_FRAME_HEADER_SIZE];
+
+	if (wc->outerror)
+		return ERROR_SERVER_REMOTE_CLOSED;
+
+	header[0] = type;
+	h_u16_to_le(header + 1, id);
+	h_u32_to_le(header + 3, (uint32_t)(timeval_ms() - wc->start_ms));
+	h_u16_to_le(header + 7, len);
+
+	if (connection_write(connection, header, sizeof(header)) != sizeof(header)
+			|| connection_write(connection, data, len) != len) {
+		LOG_ERROR("watch: error during write");
+		wc->outerror = true;
+		return ERROR_SERVER_REMOTE_CLOSED;
+	}
+
+	return ERROR_OK;
+}
+
+static int watch_reply(struct connection *connection, uint16_t id,
+		const char *msg)
+{
+	return watch_send(connection, WATCH_FRAME_REPLY, id, msg, strlen(msg));
+}
+
+static struct watch_subscription *watch_find(struct connection *connection,
+		uint16_t id)
+{
+	struct watch_subscription *sub;
+
+	list_for_each_entry(sub, &watch_subscriptions, lh) {
+		if (sub->connection == connection && sub->id == id)
+			return sub;
+	}
+
+	return NULL;
+}
+
+static void watch_remove_all(struct connection *connection)
+{
+	struct watch_subscription *sub, *tmp;
+
+	list_for_each_entry_safe(sub, tmp, &watch_subscriptions, lh) {
+		if (sub->connection == connection) {
+			list_del(&sub->lh);
+			free(sub);
+		}
+	}
+}
+
+static int watch_compare(const void *a, const void *b)
+{
+	const struct watch_subscription *sa = *(struct watch_subscription * const *)a;
+	const struct watch_subscription *sb = *(struct watch_subscription * const *)b;
+
+	if (sa->target != sb->target)
+		return (uintptr_t)sa->target < (uintptr_t)sb->target ? -1 : 1;
+	if (sa->address != sb->address)
+		return sa->address < sb->address ? -1 : 1;
+	return 0;
+}
+
+/* read [first, last) of due subscriptions in one go and fan it out */
+static void watch_sample_batch(struct watch_subscription **due,
+		unsigned first, unsigned last, int64_t now)
+{
+	struct target *target = due[first]->target;
+	target_addr_t start = due[first]->address;
+	target_addr_t end = start;
+	int retval = ERROR_FAIL;
+
+	for (unsigned i = first; i < last; i++)
+		end = MAX(end, due[i]->address + due[i]->size);
+
+	uint8_t *buf = malloc(end - start);
+	if (buf && target_was_examined(target))
+		retval = target_read_buffer(target, start, end - start, buf);
+
+	for (unsigned i = first; i < last; i++) {
+		struct watch_subscription *sub = due[i];
+
+		if (retval == ERROR_OK)
+			watch_send(sub->connection, WATCH_FRAME_SAMPLE, sub->id,
+					buf + (sub->address - start), sub->size);
+		else
+			watch_send(sub->connection, WATCH_FRAME_ERROR, sub->id, NULL, 0);
+
+		/* a slow adapter skips samples rather than bursting to catch up */
+		sub->next_due += sub->period_ms;
+		if (sub->next_due <= now)
+			sub->next_due = now + sub->period_ms;
+	}
+
+	free(buf);
+}
+
+static int watch_timer_callback(void *priv)
+{
+	struct watch_subscription *sub;
+	struct watch_subscription **due;
+	unsigned num_due = 0;
+	int64_t now = timeval_ms();
+
+	list_for_each_entry(sub, &watch_subscriptions, lh) {
+		if (sub->next_due <= now)
+			num_due++;
+	}
+	if (num_due == 0)
+		return ERROR_OK;
+
+	due = malloc(num_due * sizeof(*due));
+	if (!due)
+		return ERROR_FAIL;
+
+	num_due = 0;
+	list_for_each_entry(sub, &watch_subscriptions, lh) {
+		if (sub->next_due <= now)
+			due[num_due++] = sub;
+	}
+
+	qsort(due, num_due, sizeof(*due), watch_compare);
+
+	unsigned first = 0;
+	target_addr_t end = due[0]->address + due[0]->size;
+	for (unsigned i = 1; i <= num_due; i++) {
+		if (i < num_due && due[i]->target == due[first]->target
+				&& due[i]->address <= end
+				&& due[i]->address + due[i]->size - due[first]->address <= WATCH_MAX_BATCH) {
+			end = MAX(end, due[i]->address + due[i]->size);
+			continue;
+		}
+
+		watch_sample_batch(due, first, i, now);
+		if (i < num_due) {
+			first = i;
+			end = due[i]->address + due[i]->size;
+		}
+	}
+
+	free(due);
+	return ERROR_OK;
+}
+
+static int watch_add(struct connection *connection, char **argv, unsigned argc)
+{
+	target_addr_t address;
+	uint32_t size;
+	unsigned period;
+	uint16_t id;
+
+	if (argc != 5 || parse_u16(argv[1], &id) != ERROR_OK
+			|| parse_target_addr(argv[2], &address) != ERROR_OK
+			|| parse_u32(argv[3], &size) != ERROR_OK
+			|| parse_uint(argv[4], &period) != ERROR_OK)
+		return watch_reply(connection, 0, "ERROR syntax: add <id> <address> <size> <period_ms>");
+
+	if (size == 0 || size > WATCH_MAX_SIZE)
+		return watch_reply(connection, id, "ERROR invalid size");
+	if (period < WATCH_MIN_PERIOD)
+		return watch_reply(connection, id, "ERROR invalid period");
+	if (address + size - 1 < address)
+		return watch_reply(connection, id, "ERROR address range wraps");
+
+	struct target *target = get_current_target(connection->cmd_ctx);
+	if (!target)
+		return watch_reply(connection, id, "ERROR no current target");
+
+	struct watch_subscription *sub = watch_find(connection, id);
+	if (!sub) {
+		sub = calloc(1, sizeof(*sub));
+		if (!sub)
+			return watch_reply(connection, id, "ERROR out of memory");
+		sub->connection = connection;
+		sub->id = id;
+		list_add_tail(&sub->lh, &watch_subscriptions);
+	}
+
+	sub->target = target;
+	sub->address = address;
+	sub->size = size;
+	sub->period_ms = period;
+	sub->next_due = timeval_ms();
+
+	return watch_reply(connection, id, "OK");
+}
+
+static int watch_request(struct connection *connection, char *line)
+{
+	char *argv[6];
+	unsigned argc = 0;
+
+	for (char *tok = strtok(line, " \t\r"); tok && argc < ARRAY_SIZE(argv);
+			tok = strtok(NULL, " \t\r"))
+		argv[argc++] = tok;
+
+	if (argc == 0)
+		return ERROR_OK;
+
+	if (strcmp(argv[0], "add") == 0)
+		return watch_add(connection, argv, argc);
+
+	if (strcmp(argv[0], "remove") == 0) {
+		uint16_t id;
+		if (argc != 2 || parse_u16(argv[1], &id) != ERROR_OK)
+			return watch_reply(connection, 0, "ERROR syntax: remove <id>");
+
+		struct watch_subscription *sub = watch_find(connection, id);
+		if (!sub)
+			return watch_reply(connection, id, "ERROR unknown id");
+		list_del(&sub->lh);
+		free(sub);
+		return watch_reply(connection, id, "OK");
+	}
+
+	if (strcmp(argv[0], "clear") == 0) {
+		watch_remove_all(connection);
+		return watch_reply(connection, 0, "OK");
+	}
+
+	return watch_reply(connection, 0, "ERROR unknown request");
+}
+
+static int watch_new_connection(struct connection *connection)
+{
+	struct watch_connection *wc;
+
+	wc = calloc(1, sizeof(struct watch_connection));
+	if (wc == NULL)
+		return ERROR_CONNECTION_REJECTED;
+
+	wc->start_ms = timeval_ms();
+	connection->priv = wc;
+
+	return ERROR_OK;
+}
+
+static int watch_input(struct connection *connection)
+{
+	struct watch_connection *wc = connection->priv;
+	char in[256];
+	ssize_t rlen;
+	int retval;
+
+	rlen = connection_read(connection, in, sizeof(in));
+	if (rlen <= 0) {
+		if (rlen < 0)
+			LOG_ERROR("error during read: %s", strerror(errno));
+		return ERROR_SERVER_REMOTE_CLOSED;
+	}
+
+	for (ssize_t i = 0; i < rlen; i++) {
+		if (in[i] != '\n') {
+			if (wc->line_len < sizeof(wc->line) - 1)
+				wc->line[wc->line_len++] = in[i];
+			else
+				wc->line_drop = true;
+			continue;
+		}
+
+		if (wc->line_drop) {
+			retval = watch_reply(connection, 0, "ERROR line too long");
+		} else {
+			wc->line[wc->line_len] = '\0';
+			retval = watch_request(connection, wc->line);
+		}
+		if (retval != ERROR_OK)
+			return retval;
+
+		wc->line_len = 0;
+		wc->line_drop = false;
+	}
+
+	return wc->outerror ? ERROR_SERVER_REMOTE_CLOSED : ERROR_OK;
+}
+
+static int watch_closed(struct connection *connection)
+{
+	watch_remove_all(connection);
+
+	free(connection->priv);
+	connection->priv = NULL;
+
+	return ERROR_OK;
+}
+
+int watch_init(void)
+{
+	if (strcmp(watch_port, "disabled") == 0) {
+		LOG_INFO("watch server disabled");
+		return ERROR_OK;
+	}
+
+	int retval = add_service("watch", watch_port, CONNECTION_LIMIT_UNLIMITED,
+		&watch_new_connection, &watch_input,
+		&watch_closed, NULL);
+	if (retval != ERROR_OK)
+		return retval;
+
+	return target_register_timer_callback(watch_timer_callback,
+			WATCH_MIN_PERIOD, 1, NULL);
+}
+
+COMMAND_HANDLER(handle_watch_port_command)
+{
+	return CALL_COMMAND_HANDLER(server_pipe_command, &watch_port);
+}
+
+static const struct command_registration watch_command_handlers[] = {
+	{
+		.name = "watch_port",
+		.handler = handle_watch_port_command,
+		.mode = COMMAND_ANY,
+		.help = "Specify port on which to listen "
+			"for live memory watch clients.  "
+			"Read help on 'gdb_port'.",
+		.usage = "[port_num]",
+	},
+	COMMAND_REGISTRATION_DONE
+};
+
+int watch_register_commands(struct command_context *cmd_ctx)
+{
+	watch_port = strdup("disabled");
+	return register_commands(cmd_ctx, NULL, watch_command_handlers);
+}
+
+void watch_service_free(void)
+{
+	free(watch_port);
+}
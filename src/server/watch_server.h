@@ -0,0 +1,33 @@
+/***************************************************************************
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+#ifndef OPENOCD_SERVER_WATCH_SERVER_H
+#define OPENOCD_SERVER_WATCH_SERVER_H
+
+#include <server/server.h>
+
+/* frame types sent to watch clients */
+#define WATCH_FRAME_SAMPLE	0x01	/* payload: sampled memory */
+#define WATCH_FRAME_ERROR	0x02	/* payload: empty, the read failed */
+#define WATCH_FRAME_REPLY	0x03	/* payload: reply text to a request */
+
+/* type, id (u16), timestamp in ms (u32), payload length (u16) */
+#define WATCH_FRAME_HEADER_SIZE	9
+
+int watch_init(void);
+int watch_register_commands(struct command_context *cmd_ctx);
+void watch_service_free(void);
+
+#endif /* OPENOCD_SERVER_WATCH_SERVER_H */
@@ -0,0 +1,171 @@
+/***************************************************************************
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+#include <target/armv7m_itm.h>
+
+/* a sync packet is at least 47 zero bits followed by a one */
+#define ITM_SYNC_ZEROS		5
+#define ITM_OVERFLOW		0x70
+/* continuation bytes after a timestamp or extension header */
+#define ITM_MAX_CONTINUATION	4
+/* global timestamp packets, otherwise unused here, are the longest */
+#define ITM_MAX_RESERVED	6
+
+static void itm_emit(struct itm_decoder *dec, enum itm_packet_type type,
+		uint8_t id, uint8_t size, uint32_t value)
+{
+	struct itm_packet packet = {
+		.type = type,
+		.id = id,
+		.size = size,
+		.value = value,
+	};
+
+	dec->packet(&packet, dec->priv);
+}
+
+static void itm_start(struct itm_decoder *dec, enum itm_decoder_state state,
+		uint8_t header, uint8_t size)
+{
+	dec->state = state;
+	dec->header = header;
+	dec->count = 0;
+	dec->size = size;
+	dec->value = 0;
+}
+
+static void itm_emit_extension(struct itm_decoder *dec, uint8_t sh,
+		uint32_t value)
+{
+	/* ITM extension selects the page of the next stimulus ports */
+	if (sh == 0)
+		dec->page = value & 7;
+	itm_emit(dec, ITM_PACKET_EXTENSION, sh, 0, value);
+}
+
+static void itm_decode_header(struct itm_decoder *dec, uint8_t c)
+{
+	if (c == 0) {
+		itm_start(dec, ITM_STATE_SYNC, c, 0);
+		dec->count = 1;
+	} else if (c == ITM_OVERFLOW) {
+		itm_emit(dec, ITM_PACKET_OVERFLOW, 0, 0, 0);
+	} else if ((c & 0x0f) == 0x00) {
+		/* local timestamp, the short form carries the value itself */
+		if (c & 0x80)
+			itm_start(dec, ITM_STATE_CONTINUATION, c, ITM_MAX_CONTINUATION);
+		else
+			itm_emit(dec, ITM_PACKET_TIMESTAMP, 0, 0, (c >> 4) & 7);
+	} else if ((c & 0x0b) == 0x08) {
+		if (c & 0x80)
+			itm_start(dec, ITM_STATE_CONTINUATION, c, ITM_MAX_CONTINUATION);
+		else
+			itm_emit_extension(dec, (c >> 2) & 1, (c >> 4) & 7);
+	} else if ((c & 0x03) == 0x00) {
+		/* reserved and global timestamp packets are skipped */
+		if (c & 0x80)
+			itm_start(dec, ITM_STATE_CONTINUATION, c, ITM_MAX_RESERVED);
+	} else {
+		itm_start(dec, ITM_STATE_PAYLOAD, c, (c & 3) == 3 ? 4 : c & 3);
+	}
+}
+
+static void itm_finish_continuation(struct itm_decoder *dec)
+{
+	uint8_t c = dec->header;
+
+	if ((c & 0x0f) == 0x00) {
+		/* 0x80..0xb0 are reserved */
+		if ((c & 0xc0) == 0xc0)
+			itm_emit(dec, ITM_PACKET_TIMESTAMP, (c >> 4) & 3, 0, dec->value);
+	} else if ((c & 0x0b) == 0x08) {
+		itm_emit_extension(dec, (c >> 2) & 1, ((c >> 4) & 7) | (dec->value << 3));
+	}
+}
+
+static void itm_finish_payload(struct itm_decoder *dec)
+{
+	uint8_t c = dec->header;
+
+	if (c & 4)
+		itm_emit(dec, ITM_PACKET_HW, c >> 3, dec->size, dec->value);
+	else
+		itm_emit(dec, ITM_PACKET_SWIT, dec->page * 32 + (c >> 3),
+				dec->size, dec->value);
+}
+
+void itm_decoder_init(struct itm_decoder *dec,
+		void (*packet)(const struct itm_packet *packet, void *priv), void *priv)
+{
+	memset(dec, 0, sizeof(*dec));
+	dec->state = ITM_STATE_HEADER;
+	dec->packet = packet;
+	dec->priv = priv;
+}
+
+void itm_decode(struct itm_decoder *dec, const uint8_t *data, size_t len)
+{
+	for (size_t i = 0; i < len; i++) {
+		uint8_t c = data[i];
+
+		switch (dec->state) {
+		case ITM_STATE_HEADER:
+			itm_decode_header(dec, c);
+			break;
+
+		case ITM_STATE_SYNC:
+			if (c == 0) {
+				if (dec->count < ITM_SYNC_ZEROS)
+					dec->count++;
+				break;
+			}
+			dec->state = ITM_STATE_HEADER;
+			if (c == 0x80 && dec->count >= ITM_SYNC_ZEROS) {
+				itm_emit(dec, ITM_PACKET_SYNC, 0, 0, 0);
+				break;
+			}
+			/* stray zeros, start over with this byte */
+			dec->errors += dec->count;
+			itm_decode_header(dec, c);
+			break;
+
+		case ITM_STATE_PAYLOAD:
+			dec->value |= (uint32_t)c << (8 * dec->count);
+			if (++dec->count == dec->size) {
+				dec->state = ITM_STATE_HEADER;
+				itm_finish_payload(dec);
+			}
+			break;
+
+		case ITM_STATE_CONTINUATION:
+			if (7 * dec->count < 32)
+				dec->value |= (uint32_t)(c & 0x7f) << (7 * dec->count);
+			dec->count++;
+			if (!(c & 0x80)) {
+				dec->state = ITM_STATE_HEADER;
+				itm_finish_continuation(dec);
+			} else if (dec->count == dec->size) {
+				dec->state = ITM_STATE_HEADER;
+				dec->errors += dec->count + 1;
+			}
+			break;
+		}
+	}
+}
@@ -0,0 +1,80 @@
+/***************************************************************************
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+#ifndef OPENOCD_TARGET_ARMV7M_ITM_H
+#define OPENOCD_TARGET_ARMV7M_ITM_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * @file
+ * Incremental decoder for the ITM and DWT trace packet protocol, see
+ * Appendix D4 "Debug ITM and DWT Packet Protocol" of the ARMv7-M
+ * Architecture Reference Manual. Data can be fed in chunks of any size,
+ * packets split across chunks are completed by the next call.
+ */
+
+/* DWT hardware source packet discriminators */
+#define ITM_HW_EVENT_COUNTER	0
+#define ITM_HW_EXCEPTION		1
+#define ITM_HW_PC_SAMPLE		2
+
+enum itm_packet_type {
+	ITM_PACKET_SYNC,		/**< synchronization packet */
+	ITM_PACKET_OVERFLOW,	/**< ITM or DWT dropped packets */
+	ITM_PACKET_TIMESTAMP,	/**< local timestamp, id is the TC field */
+	ITM_PACKET_EXTENSION,	/**< extension, id is the SH bit */
+	ITM_PACKET_SWIT,		/**< instrumentation, id is the stimulus port */
+	ITM_PACKET_HW,			/**< DWT hardware source, id is the discriminator */
+};
+
+struct itm_packet {
+	enum itm_packet_type type;
+	uint8_t id;
+	/** Payload bytes of source packets: 1, 2 or 4 */
+	uint8_t size;
+	uint32_t value;
+};
+
+enum itm_decoder_state {
+	ITM_STATE_HEADER,
+	ITM_STATE_SYNC,
+	ITM_STATE_PAYLOAD,
+	ITM_STATE_CONTINUATION,
+};
+
+struct itm_decoder {
+	enum itm_decoder_state state;
+	uint8_t header;
+	/** Payload or continuation bytes received */
+	uint8_t count;
+	/** Payload bytes expected, or continuation bytes allowed */
+	uint8_t size;
+	uint32_t value;
+	/** Stimulus port page set by an ITM extension packet */
+	uint8_t page;
+
+	void (*packet)(const struct itm_packet *packet, void *priv);
+	void *priv;
+	/** Bytes dropped while looking for a valid header */
+	unsigned int errors;
+};
+
+void itm_decoder_init(struct itm_decoder *dec,
+		void (*packet)(const struct itm_packet *packet, void *priv), void *priv);
+void itm_decode(struct itm_decoder *dec, const uint8_t *data, size_t len);
+
+#endif /* OPENOCD_TARGET_ARMV7M_ITM_H */
@@ -24,29 +24,61 @@
 #include <target/cortex_m.h>
 #include <target/armv7m_trace.h>
 #include <jtag/interface.h>
+#include <helper/time_support.h>
 
 #define TRACE_BUF_SIZE	4096
+/* adapter reads per poll, so a busy main loop can catch up */
+#define TRACE_POLL_MAX_READS	16
+/* stdio buffer for the trace file, and how often it is flushed */
+#define TRACE_FILE_BUF_SIZE	(256 * 1024)
+#define TRACE_FILE_FLUSH_MS	100
 
 static int armv7m_poll_trace(void *target)
 {
 	struct armv7m_common *armv7m = target_to_armv7m(target);
+	struct armv7m_trace_config *trace_config = &armv7m->trace_config;
 	uint8_t buf[TRACE_BUF_SIZE];
-	size_t size = sizeof(buf);
+	size_t size;
 	int retval;
+	int reads;
 
-	retval = adapter_poll_trace(buf, &size);
-	if (retval != ERROR_OK || !size)
-		return retval;
+	/* keep reading while the adapter fills the whole buffer; some
+	 * adapters leave one byte spare */
+	for (reads = 0; reads < TRACE_POLL_MAX_READS; reads++) {
+		size = sizeof(buf);
+		retval = adapter_poll_trace(buf, &size);
+		if (retval != ERROR_OK)
+			return retval;
+		if (!size)
+			break;
 
-	target_call_trace_callbacks(target, size, buf);
+		target_call_trace_callbacks(target, size, buf);
 
-	if (armv7m->trace_config.trace_file != NULL) {
-		if (fwrite(buf, 1, size, armv7m->trace_config.trace_file) == size)
-			fflush(armv7m->trace_config.trace_file);
-		else {
+		if (trace_config->trace_file != NULL &&
+				fwrite(buf, 1, size, trace_config->trace_file) != size) {
 			LOG_ERROR("Error writing to the trace destination file");
 			return ERROR_FAIL;
 		}
+
+		if (size < sizeof(buf) - 1)
+			break;
+	}
+
+	if (reads == TRACE_POLL_MAX_READS) {
+		if (!trace_config->trace_backlog_count++)
+			LOG_WARNING("Trace data arrives faster than it is read, "
+				"the adapter may drop some");
+		else
+			LOG_DEBUG("trace backlog, %u times so far",
+				trace_config->trace_backlog_count);
+	}
+
+	if (trace_config->trace_file != NULL) {
+		int64_t now = timeval_ms();
+		if (now - trace_config->trace_file_flushed >= TRACE_FILE_FLUSH_MS) {
+			fflush(trace_config->trace_file);
+			trace_config->trace_file_flushed = now;
+		}
 	}
 
 	return ERROR_OK;
@@ -115,8 +147,10 @@ int armv7m_trace_tpiu_config(struct target *target)
 	if (retval != ERROR_OK)
 		return retval;
 
-	if (trace_config->config_type == TRACE_CONFIG_TYPE_INTERNAL)
+	if (trace_config->config_type == TRACE_CONFIG_TYPE_INTERNAL) {
+		trace_config->trace_backlog_count = 0;
 		target_register_timer_callback(armv7m_poll_trace, 1, 1, target);
+	}
 
 	target_call_event_callbacks(target, TARGET_EVENT_TRACE_CONFIG);
 
@@ -197,6 +231,9 @@ COMMAND_HANDLER(handle_tpiu_config_command)
 					LOG_ERROR("Can't open trace destination file");
 					return ERROR_FAIL;
 				}
+				/* written in large chunks, flushed by the poll */
+				setvbuf(armv7m->trace_config.trace_file, NULL, _IOFBF,
+					TRACE_FILE_BUF_SIZE);
 			}
 		}
 		cmd_idx++;
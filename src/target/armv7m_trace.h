@@ -75,6 +75,10 @@ struct armv7m_trace_config {
 	unsigned int trace_freq;
 	/** Handle to output trace data in INTERNAL capture mode */
 	FILE *trace_file;
+	/** Time of the last flush of trace_file, in ms */
+	int64_t trace_file_flushed;
+	/** Number of polls that left data behind in the adapter */
+	unsigned int trace_backlog_count;
 };
 
 extern const struct command_registration armv7m_trace_command_handlers[];
@@ -38,6 +38,7 @@
 #include "register.h"
 #include "arm_opcodes.h"
 #include "arm_semihosting.h"
+#include "armv7m_itm.h"
 #include <helper/time_support.h>
 
 /* NOTE:  most of this should work fine for the Cortex-M1 and
@@ -393,6 +394,168 @@ static int cortex_m_examine_exception_reason(struct target *target)
 	return retval;
 }
 
+/* Queue a core register read through DCRSR/DCRDR without waiting for
+ * the transfer. When dhcsr is given, DHCSR is read in between so that
+ * S_REGRDY can be checked once the whole queue has been run. */
+static int cortex_m_queue_reg_read(struct target *target, uint32_t regsel,
+		uint32_t *reg_value, uint32_t *dhcsr)
+{
+	struct armv7m_common *armv7m = target_to_armv7m(target);
+	int retval;
+
+	retval = mem_ap_write_u32(armv7m->debug_ap, DCB_DCRSR, regsel);
+	if (retval != ERROR_OK)
+		return retval;
+
+	if (dhcsr) {
+		retval = mem_ap_read_u32(armv7m->debug_ap, DCB_DHCSR, dhcsr);
+		if (retval != ERROR_OK)
+			return retval;
+	}
+
+	return mem_ap_read_u32(armv7m->debug_ap, DCB_DCRDR, reg_value);
+}
+
+/* Debug Core Register Selector for a register cache entry; D0..D15 map
+ * to the even S register, the odd half follows at regsel + 1 */
+static uint32_t cortex_m_reg_id_to_regsel(unsigned id)
+{
+	switch (id) {
+		case ARMV7M_PRIMASK:
+		case ARMV7M_BASEPRI:
+		case ARMV7M_FAULTMASK:
+		case ARMV7M_CONTROL:
+			return 20;
+		case ARMV7M_D0 ... ARMV7M_D15:
+			return 0x40 + 2 * (id - ARMV7M_D0);
+		case ARMV7M_FPSCR:
+			return 0x21;
+		default:
+			return id;
+	}
+}
+
+/* Read all core registers in a single DAP transaction instead of one
+ * round trip per register. Returns ERROR_TIMEOUT_REACHED if the core
+ * did not keep up (S_REGRDY clear); the cache is left untouched then. */
+static int cortex_m_fast_read_all_regs(struct target *target)
+{
+	struct cortex_m_common *cortex_m = target_to_cm(target);
+	struct armv7m_common *armv7m = &cortex_m->armv7m;
+	struct reg_cache *cache = armv7m->arm.core_cache;
+	bool check_regrdy = cortex_m->reg_read_mode != CORTEX_M_REG_READ_NOCHECK;
+	uint32_t r_vals[2 * ARMV7M_LAST_REG];
+	uint32_t dhcsr[2 * ARMV7M_LAST_REG];
+	unsigned special_idx = 0;
+	bool special_queued = false;
+	unsigned wi = 0, ri = 0;
+	uint32_t dcrdr;
+	int retval;
+
+	/* because the DCB_DCRDR is used for the emulated dcc channel
+	 * we have to save/restore the DCB_DCRDR when used */
+	if (target->dbg_msg_enabled) {
+		retval = mem_ap_read_u32(armv7m->debug_ap, DCB_DCRDR, &dcrdr);
+		if (retval != ERROR_OK)
+			return retval;
+	}
+
+	for (unsigned i = 0; i < cache->num_regs; i++) {
+		struct reg *r = &cache->reg_list[i];
+		unsigned id = ((struct arm_reg *)r->arch_info)->num;
+		uint32_t regsel = cortex_m_reg_id_to_regsel(id);
+
+		if (!r->exist)
+			continue;
+
+		if (regsel == 20) {
+			/* PRIMASK, BASEPRI, FAULTMASK and CONTROL share one
+			 * Debug Core register, fetch it only once */
+			if (special_queued)
+				continue;
+			special_queued = true;
+			special_idx = wi;
+		}
+
+		retval = cortex_m_queue_reg_read(target, regsel, &r_vals[wi],
+				check_regrdy ? &dhcsr[wi] : NULL);
+		if (retval != ERROR_OK)
+			return retval;
+		wi++;
+
+		if (r->size == 64) {
+			retval = cortex_m_queue_reg_read(target, regsel + 1, &r_vals[wi],
+					check_regrdy ? &dhcsr[wi] : NULL);
+			if (retval != ERROR_OK)
+				return retval;
+			wi++;
+		}
+	}
+
+	retval = dap_run(armv7m->debug_ap->dap);
+	if (retval != ERROR_OK)
+		return retval;
+
+	if (target->dbg_msg_enabled) {
+		/* restore DCB_DCRDR - this needs to be in a separate
+		 * transaction otherwise the emulated DCC channel breaks */
+		retval = mem_ap_write_atomic_u32(armv7m->debug_ap, DCB_DCRDR, dcrdr);
+		if (retval != ERROR_OK)
+			return retval;
+	}
+
+	if (check_regrdy) {
+		for (unsigned i = 0; i < wi; i++) {
+			if (!(dhcsr[i] & S_REGRDY)) {
+				LOG_DEBUG("register transfer %u not ready during fast read", i);
+				return ERROR_TIMEOUT_REACHED;
+			}
+		}
+	}
+
+	for (unsigned i = 0; i < cache->num_regs; i++) {
+		struct reg *r = &cache->reg_list[i];
+		unsigned id = ((struct arm_reg *)r->arch_info)->num;
+		uint32_t special;
+
+		if (!r->exist)
+			continue;
+
+		switch (id) {
+			case ARMV7M_PRIMASK:
+			case ARMV7M_BASEPRI:
+			case ARMV7M_FAULTMASK:
+			case ARMV7M_CONTROL:
+				special = r_vals[special_idx];
+				if (special_idx == ri)
+					ri++;
+				if (id == ARMV7M_PRIMASK)
+					special = buf_get_u32((uint8_t *)&special, 0, 1);
+				else if (id == ARMV7M_BASEPRI)
+					special = buf_get_u32((uint8_t *)&special, 8, 8);
+				else if (id == ARMV7M_FAULTMASK)
+					special = buf_get_u32((uint8_t *)&special, 16, 1);
+				else
+					special = buf_get_u32((uint8_t *)&special, 24, 2);
+				buf_set_u32(r->value, 0, 32, special);
+				break;
+
+			default:
+				buf_set_u32(r->value, 0, 32, r_vals[ri++]);
+				if (r->size == 64)
+					buf_set_u32(r->value + 4, 0, 32, r_vals[ri++]);
+				break;
+		}
+
+		r->valid = true;
+		r->dirty = false;
+	}
+
+	LOG_DEBUG("read %u core register words in one transaction", wi);
+
+	return ERROR_OK;
+}
+
 static int cortex_m_debug_entry(struct target *target)
 {
 	int i;
@@ -416,6 +579,17 @@ static int cortex_m_debug_entry(struct target *target)
 
 	/* Examine target state and mode
 	 * First load register accessible through core debug port */
+	if (cortex_m->reg_read_mode != CORTEX_M_REG_READ_SLOW
+			&& !cortex_m->slow_register_read) {
+		retval = cortex_m_fast_read_all_regs(target);
+		if (retval == ERROR_TIMEOUT_REACHED) {
+			cortex_m->slow_register_read = true;
+			LOG_DEBUG("switched to slow register read");
+		} else if (retval != ERROR_OK)
+			return retval;
+	}
+
+	/* anything the fast path did not fetch is read one by one */
 	int num_regs = arm->core_cache->num_regs;
 
 	for (i = 0; i < num_regs; i++) {
@@ -1688,6 +1862,166 @@ void cortex_m_deinit_target(struct target *target)
 	free(cortex_m);
 }
 
+struct cortex_m_swo_profile {
+	struct target *target;
+	struct itm_decoder decoder;
+	uint32_t *samples;
+	uint32_t max_num_samples;
+	uint32_t num_samples;
+	/* keep every stride-th sample, doubled each time the buffer fills */
+	uint32_t stride;
+	uint32_t skipped;
+
+	uint32_t received;
+	uint32_t sleeping;
+	uint32_t overflows;
+};
+
+static void cortex_m_swo_profile_packet(const struct itm_packet *packet,
+		void *priv)
+{
+	struct cortex_m_swo_profile *prof = priv;
+
+	if (packet->type == ITM_PACKET_OVERFLOW) {
+		prof->overflows++;
+		return;
+	}
+	if (packet->type != ITM_PACKET_HW || packet->id != ITM_HW_PC_SAMPLE)
+		return;
+
+	prof->received++;
+	/* a one byte PC sample means the core was sleeping */
+	if (packet->size != 4) {
+		prof->sleeping++;
+		return;
+	}
+
+	if (++prof->skipped < prof->stride)
+		return;
+	prof->skipped = 0;
+
+	if (prof->num_samples == prof->max_num_samples) {
+		for (uint32_t i = 0; i < prof->num_samples / 2; i++)
+			prof->samples[i] = prof->samples[2 * i];
+		prof->num_samples /= 2;
+		prof->stride *= 2;
+	}
+	prof->samples[prof->num_samples++] = packet->value;
+}
+
+static int cortex_m_swo_profile_trace(struct target *target, size_t len,
+		uint8_t *data, void *priv)
+{
+	struct cortex_m_swo_profile *prof = priv;
+
+	if (target == prof->target)
+		itm_decode(&prof->decoder, data, len);
+
+	return ERROR_OK;
+}
+
+/* Pick the DWT PC sampling period, in core cycles, so that the samples
+ * take about half of the trace port bandwidth */
+static uint32_t cortex_m_swo_profile_ctrl(struct armv7m_trace_config *trace_config,
+		uint32_t *period)
+{
+	uint64_t bytes_per_sec;
+
+	if (trace_config->pin_protocol == TPIU_PIN_PROTOCOL_SYNC)
+		bytes_per_sec = (uint64_t)trace_config->trace_freq * trace_config->port_size / 8;
+	else
+		bytes_per_sec = trace_config->trace_freq / 10;
+
+	/* a PC sample packet is five bytes long */
+	uint64_t rate = MAX(bytes_per_sec / 5 / 2, 1);
+	uint64_t cycles = DIV_ROUND_UP(trace_config->traceclkin_freq, rate);
+
+	if (cycles <= 16 * 64) {
+		uint32_t postpreset = cycles > 64 ? DIV_ROUND_UP(cycles, 64) - 1 : 0;
+		*period = (postpreset + 1) * 64;
+		return DWT_CTRL_POSTPRESET(postpreset);
+	}
+
+	uint32_t postpreset = MIN(DIV_ROUND_UP(cycles, 1024) - 1, 15);
+	*period = (postpreset + 1) * 1024;
+	return DWT_CTRL_POSTPRESET(postpreset) | DWT_CTRL_CYCTAP;
+}
+
+/* Profile with the periodic PC samples the DWT sends along the trace
+ * data captured by the adapter, without ever halting the core */
+static int cortex_m_profiling_swo(struct target *target, uint32_t *samples,
+		uint32_t max_num_samples, uint32_t *num_samples, uint32_t seconds)
+{
+	struct armv7m_common *armv7m = target_to_armv7m(target);
+	struct armv7m_trace_config *trace_config = &armv7m->trace_config;
+	struct cortex_m_swo_profile prof = {
+		.target = target,
+		.samples = samples,
+		.max_num_samples = max_num_samples,
+		.stride = 1,
+	};
+	uint32_t dwt_ctrl, ctrl, period;
+	int retval;
+
+	retval = target_read_u32(target, DWT_CTRL, &dwt_ctrl);
+	if (retval != ERROR_OK)
+		return retval;
+
+	retval = armv7m_trace_itm_config(target);
+	if (retval != ERROR_OK)
+		return retval;
+
+	/* the sampling period may only change while sampling is off */
+	ctrl = dwt_ctrl & ~(DWT_CTRL_POSTPRESET_MASK | DWT_CTRL_CYCTAP | DWT_CTRL_PCSAMPLENA);
+	ctrl |= cortex_m_swo_profile_ctrl(trace_config, &period) | DWT_CTRL_CYCCNTENA;
+	retval = target_write_u32(target, DWT_CTRL, ctrl);
+	if (retval != ERROR_OK)
+		return retval;
+
+	itm_decoder_init(&prof.decoder, cortex_m_swo_profile_packet, &prof);
+	target_register_trace_callback(cortex_m_swo_profile_trace, &prof);
+
+	LOG_INFO("Starting Cortex-M profiling. Sampling the PC over trace "
+			"every %" PRIu32 " cycles...", period);
+
+	retval = target_write_u32(target, DWT_CTRL, ctrl | DWT_CTRL_PCSAMPLENA);
+
+	/* Make sure the target is running */
+	if (retval == ERROR_OK)
+		retval = target_poll(target);
+	if (retval == ERROR_OK && target->state == TARGET_HALTED)
+		retval = target_resume(target, 1, 0, 0, 0);
+
+	int64_t start = timeval_ms();
+	while (retval == ERROR_OK && timeval_ms() - start < seconds * 1000LL) {
+		/* the adapter trace is read by a timer callback */
+		target_call_timer_callbacks_now();
+		usleep(1000);
+	}
+	int64_t elapsed = MAX(timeval_ms() - start, 1);
+	int64_t rate = (int64_t)prof.received * 1000 / elapsed;
+
+	int retval2 = target_write_u32(target, DWT_CTRL, dwt_ctrl);
+	target_unregister_trace_callback(cortex_m_swo_profile_trace, &prof);
+	if (retval == ERROR_OK)
+		retval = retval2;
+	if (retval != ERROR_OK) {
+		LOG_ERROR("Error while profiling over trace");
+		return retval;
+	}
+
+	LOG_INFO("Profiling completed. %" PRIu32 " samples.", prof.num_samples);
+	LOG_INFO("%" PRIu32 " PC samples received (%" PRId64 "/s), %" PRIu32
+			" while sleeping, %" PRIu32 " trace overflows, 1 in %" PRIu32 " kept",
+			prof.received, rate, prof.sleeping,
+			prof.overflows, prof.stride);
+	if (prof.received == 0)
+		LOG_WARNING("No PC samples received, check the TPIU and SWO configuration");
+
+	*num_samples = prof.num_samples;
+	return ERROR_OK;
+}
+
 int cortex_m_profiling(struct target *target, uint32_t *samples,
 			      uint32_t max_num_samples, uint32_t *num_samples, uint32_t seconds)
 {
@@ -1698,6 +2032,10 @@ int cortex_m_profiling(struct target *target, uint32_t *samples,
 	int retval = ERROR_OK;
 	struct reg *reg;
 
+	if (armv7m->trace_config.config_type == TRACE_CONFIG_TYPE_INTERNAL)
+		return cortex_m_profiling_swo(target, samples, max_num_samples,
+				num_samples, seconds);
+
 	gettimeofday(&timeout, NULL);
 	timeval_add_time(&timeout, seconds, 0);
 
@@ -2000,6 +2338,9 @@ int cortex_m_examine(struct target *target)
 		/* Leave (only) generic DAP stuff for debugport_init(); */
 		armv7m->debug_ap->memaccess_tck = 8;
 
+		/* a re-examined core gets another chance at fast register reads */
+		cortex_m->slow_register_read = false;
+
 		retval = mem_ap_init(armv7m->debug_ap);
 		if (retval != ERROR_OK)
 			return retval;
@@ -2404,6 +2745,39 @@ COMMAND_HANDLER(handle_cortex_m_mask_interrupts_command)
 	return ERROR_OK;
 }
 
+COMMAND_HANDLER(handle_cortex_m_reg_read_command)
+{
+	struct target *target = get_current_target(CMD_CTX);
+	struct cortex_m_common *cortex_m = target_to_cm(target);
+	int retval;
+
+	static const Jim_Nvp nvp_reg_read_modes[] = {
+		{ .name = "fast", .value = CORTEX_M_REG_READ_FAST },
+		{ .name = "nocheck", .value = CORTEX_M_REG_READ_NOCHECK },
+		{ .name = "slow", .value = CORTEX_M_REG_READ_SLOW },
+		{ .name = NULL, .value = -1 },
+	};
+	const Jim_Nvp *n;
+
+	retval = cortex_m_verify_pointer(CMD_CTX, cortex_m);
+	if (retval != ERROR_OK)
+		return retval;
+
+	if (CMD_ARGC > 0) {
+		n = Jim_Nvp_name2value_simple(nvp_reg_read_modes, CMD_ARGV[0]);
+		if (n->name == NULL)
+			return ERROR_COMMAND_SYNTAX_ERROR;
+		cortex_m->reg_read_mode = n->value;
+		cortex_m->slow_register_read = false;
+	}
+
+	n = Jim_Nvp_value2name_simple(nvp_reg_read_modes, cortex_m->reg_read_mode);
+	command_print(CMD_CTX, "cortex_m reg_read %s%s", n->name,
+			cortex_m->slow_register_read ? " (fell back to slow)" : "");
+
+	return ERROR_OK;
+}
+
 COMMAND_HANDLER(handle_cortex_m_reset_config_command)
 {
 	struct target *target = get_current_target(CMD_CTX);
@@ -2463,6 +2837,13 @@ static const struct command_registration cortex_m_exec_command_handlers[] = {
 		.help = "configure software reset handling",
 		.usage = "['srst'|'sysresetreq'|'vectreset']",
 	},
+	{
+		.name = "reg_read",
+		.handler = handle_cortex_m_reg_read_command,
+		.mode = COMMAND_ANY,
+		.help = "configure how core registers are read on debug entry",
+		.usage = "['fast'|'nocheck'|'slow']",
+	},
 	COMMAND_REGISTRATION_DONE
 };
 static const struct command_registration cortex_m_command_handlers[] = {
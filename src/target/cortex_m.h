@@ -53,6 +53,12 @@
 #define DWT_MASK0	0xE0001024
 #define DWT_FUNCTION0	0xE0001028
 
+#define DWT_CTRL_CYCCNTENA	(1 << 0)
+#define DWT_CTRL_POSTPRESET(n)	((n) << 1)
+#define DWT_CTRL_POSTPRESET_MASK	(0xf << 1)
+#define DWT_CTRL_CYCTAP		(1 << 9)
+#define DWT_CTRL_PCSAMPLENA	(1 << 12)
+
 #define FP_CTRL		0xE0002000
 #define FP_REMAP	0xE0002004
 #define FP_COMP0	0xE0002008
@@ -161,6 +167,12 @@ enum cortex_m_isrmasking_mode {
 	CORTEX_M_ISRMASK_ON,
 };
 
+enum cortex_m_reg_read_mode {
+	CORTEX_M_REG_READ_FAST,		/* queued, S_REGRDY checked afterwards */
+	CORTEX_M_REG_READ_NOCHECK,	/* queued, S_REGRDY not checked */
+	CORTEX_M_REG_READ_SLOW,		/* one transaction per register */
+};
+
 struct cortex_m_common {
 	int common_magic;
 
@@ -187,6 +199,10 @@ struct cortex_m_common {
 
 	enum cortex_m_isrmasking_mode isrmasking_mode;
 
+	enum cortex_m_reg_read_mode reg_read_mode;
+	/* set when a fast register read found S_REGRDY clear */
+	bool slow_register_read;
+
 	struct armv7m_common armv7m;
 
 	int apsel;
@@ -0,0 +1,637 @@
+/***************************************************************************
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <helper/log.h>
+#include <helper/binarybuffer.h>
+
+#include "target.h"
+#include "target_type.h"
+#include "register.h"
+#include "memcache.h"
+
+#define MEMCACHE_MAX_PREFETCH_WINDOW	0x10000
+
+#define PAGE_BASE(addr) ((addr) & ~(target_addr_t)(MEMCACHE_PAGE_SIZE - 1))
+
+static struct hlist_head *memcache_bucket(struct memcache *mc,
+		target_addr_t address)
+{
+	return &mc->hash[(address / MEMCACHE_PAGE_SIZE) & (MEMCACHE_HASH_SIZE - 1)];
+}
+
+static struct memcache *memcache_get(struct target *target)
+{
+	struct memcache *mc = target->memcache;
+
+	if (mc)
+		return mc;
+
+	mc = calloc(1, sizeof(*mc));
+	if (!mc)
+		return NULL;
+
+	INIT_LIST_HEAD(&mc->pages);
+	INIT_LIST_HEAD(&mc->regions);
+	mc->max_pages = MEMCACHE_DEFAULT_MAX_PAGES;
+	target->memcache = mc;
+	return mc;
+}
+
+static struct memcache_page *memcache_find(struct memcache *mc,
+		target_addr_t address)
+{
+	struct memcache_page *page;
+	struct hlist_node *node;
+
+	hlist_for_each_entry(page, node, memcache_bucket(mc, address), hash) {
+		if (page->address == address)
+			return page;
+	}
+
+	return NULL;
+}
+
+/* region that holds all of [address, address + count), if any */
+static struct memcache_region *memcache_find_region(struct memcache *mc,
+		target_addr_t address, uint32_t count)
+{
+	struct memcache_region *region;
+
+	list_for_each_entry(region, &mc->regions, lh) {
+		if (address >= region->address
+				&& address - region->address + count <= region->size)
+			return region;
+	}
+
+	return NULL;
+}
+
+static void memcache_drop_page(struct memcache *mc, struct memcache_page *page)
+{
+	list_del(&page->lh);
+	hlist_del(&page->hash);
+	free(page);
+	mc->num_pages--;
+}
+
+/* Drop pages; with only_volatile set the ones from read-only regions
+ * are kept. Returns true if anything was dropped. */
+static bool memcache_drop(struct memcache *mc, bool only_volatile)
+{
+	struct memcache_page *page, *tmp;
+	bool dropped = false;
+
+	list_for_each_entry_safe(page, tmp, &mc->pages, lh) {
+		if (only_volatile && page->persistent)
+			continue;
+		memcache_drop_page(mc, page);
+		dropped = true;
+	}
+
+	return dropped;
+}
+
+static int memcache_insert(struct memcache *mc, target_addr_t address,
+		const uint8_t *data, bool persistent)
+{
+	struct memcache_page *page = memcache_find(mc, address);
+
+	if (page) {
+		memcpy(page->data, data, MEMCACHE_PAGE_SIZE);
+		page->persistent = persistent;
+		list_move(&page->lh, &mc->pages);
+		return ERROR_OK;
+	}
+
+	if (mc->num_pages >= mc->max_pages) {
+		/* evict the least recently used page */
+		page = list_entry(mc->pages.prev, struct memcache_page, lh);
+		list_del(&page->lh);
+		hlist_del(&page->hash);
+		mc->num_pages--;
+		mc->evictions++;
+	} else {
+		page = malloc(sizeof(*page));
+		if (!page)
+			return ERROR_FAIL;
+	}
+
+	page->address = address;
+	page->persistent = persistent;
+	memcpy(page->data, data, MEMCACHE_PAGE_SIZE);
+	list_add(&page->lh, &mc->pages);
+	hlist_add_head(&page->hash, memcache_bucket(mc, address));
+	mc->num_pages++;
+
+	return ERROR_OK;
+}
+
+/* Read [address, address + size) rounded out to whole pages. The range
+ * is fetched in one transfer; if that faults (e.g. it runs off the end of
+ * RAM) the pages are retried one by one and the readable ones kept.
+ * Returns ERROR_OK only if every page made it into the cache. */
+static int memcache_fill(struct target *target, target_addr_t address,
+		uint32_t size, bool persistent)
+{
+	struct memcache *mc = target->memcache;
+	target_addr_t first = PAGE_BASE(address);
+	target_addr_t end = PAGE_BASE(address + size - 1) + MEMCACHE_PAGE_SIZE;
+
+	if (end <= first)
+		return ERROR_FAIL;
+
+	uint32_t len = end - first;
+	uint8_t *buf = malloc(len);
+	if (!buf)
+		return ERROR_FAIL;
+
+	mc->filling = true;
+	int retval = target->type->read_buffer(target, first, len, buf);
+	int result = retval;
+	for (uint32_t offset = 0; offset < len; offset += MEMCACHE_PAGE_SIZE) {
+		if (retval != ERROR_OK) {
+			if (target->type->read_buffer(target, first + offset,
+					MEMCACHE_PAGE_SIZE, buf + offset) != ERROR_OK)
+				continue;
+		}
+		if (memcache_insert(mc, first + offset, buf + offset,
+				persistent) != ERROR_OK)
+			result = ERROR_FAIL;
+	}
+	mc->filling = false;
+
+	free(buf);
+	return result;
+}
+
+/* Read [address, address + len), whole pages, in one transfer and cache
+ * it only if all of it could be read. */
+static int memcache_read_pages(struct target *target, target_addr_t address,
+		uint32_t len)
+{
+	struct memcache *mc = target->memcache;
+	uint8_t *buf = malloc(len);
+	if (!buf)
+		return ERROR_FAIL;
+
+	mc->filling = true;
+	int retval = target->type->read_buffer(target, address, len, buf);
+	for (uint32_t offset = 0; retval == ERROR_OK && offset < len;
+			offset += MEMCACHE_PAGE_SIZE)
+		retval = memcache_insert(mc, address + offset, buf + offset, false);
+	mc->filling = false;
+
+	free(buf);
+	return retval;
+}
+
+static bool memcache_has_pages(struct memcache *mc, target_addr_t first,
+		target_addr_t last)
+{
+	for (target_addr_t a = first; ; a += MEMCACHE_PAGE_SIZE) {
+		if (!memcache_find(mc, a))
+			return false;
+		if (a == last)
+			return true;
+	}
+}
+
+bool memcache_read(struct target *target, target_addr_t address,
+		uint32_t count, uint8_t *buffer)
+{
+	struct memcache *mc = target->memcache;
+
+	if (!mc || mc->filling || count == 0)
+		return false;
+
+	if (address + count - 1 < address)
+		return false;
+
+	struct memcache_region *region = memcache_find_region(mc, address, count);
+	bool persistent = region && region->type == MEMCACHE_REGION_RO;
+
+	if (target->state != TARGET_HALTED && !persistent)
+		return false;
+
+	target_addr_t first = PAGE_BASE(address);
+	target_addr_t last = PAGE_BASE(address + count - 1);
+
+	if (memcache_has_pages(mc, first, last)) {
+		mc->hits++;
+	} else {
+		mc->misses++;
+
+		/* outside declared regions only prefetched data is used; a
+		 * fill larger than the cache would evict its own pages */
+		if (!region || (last - first) / MEMCACHE_PAGE_SIZE >= mc->max_pages)
+			return false;
+
+		if (memcache_fill(target, first, last - first + MEMCACHE_PAGE_SIZE,
+				persistent) != ERROR_OK)
+			return false;
+		mc->fills++;
+	}
+
+	while (count > 0) {
+		struct memcache_page *page = memcache_find(mc, PAGE_BASE(address));
+		/* a fill may have lost pages to eviction or a failed allocation */
+		if (!page)
+			return false;
+		uint32_t offset = address - page->address;
+		uint32_t n = MIN(count, MEMCACHE_PAGE_SIZE - offset);
+
+		memcpy(buffer, page->data + offset, n);
+		list_move(&page->lh, &mc->pages);
+		address += n;
+		buffer += n;
+		count -= n;
+	}
+
+	return true;
+}
+
+void memcache_invalidate(struct target *target)
+{
+	struct memcache *mc = target->memcache;
+
+	if (mc && memcache_drop(mc, false))
+		mc->invalidations++;
+}
+
+void memcache_invalidate_volatile(struct target *target)
+{
+	struct memcache *mc = target->memcache;
+
+	if (mc && memcache_drop(mc, true))
+		mc->invalidations++;
+}
+
+void memcache_invalidate_range(struct target *target,
+		target_addr_t address, uint32_t count)
+{
+	struct memcache *mc = target->memcache;
+	struct memcache_page *page, *tmp;
+	bool dropped = false;
+
+	if (!mc || mc->num_pages == 0 || count == 0)
+		return;
+
+	target_addr_t first = PAGE_BASE(address);
+	target_addr_t last = PAGE_BASE(address + count - 1);
+
+	list_for_each_entry_safe(page, tmp, &mc->pages, lh) {
+		/* written range may wrap, then everything above first and
+		 * below last is affected */
+		bool hit = first <= last
+			? page->address >= first && page->address <= last
+			: page->address >= first || page->address <= last;
+		if (hit) {
+			memcache_drop_page(mc, page);
+			dropped = true;
+		}
+	}
+
+	if (dropped)
+		mc->invalidations++;
+}
+
+void memcache_prefetch(struct target *target)
+{
+	struct memcache *mc = target->memcache;
+
+	if (!mc || target->state != TARGET_HALTED)
+		return;
+
+	/* the target may have run without going through target_resume() */
+	memcache_drop(mc, true);
+
+	if (mc->prefetch_window == 0)
+		return;
+
+	for (unsigned i = 0; i < mc->num_prefetch_regs; i++) {
+		const char *name = mc->prefetch_regs[i];
+		struct reg *reg = register_get_by_name(target->reg_cache, name, 1);
+
+		if (!reg || reg->size > 64)
+			continue;
+		if (!reg->valid && reg->type->get(reg) != ERROR_OK)
+			continue;
+
+		target_addr_t value = buf_get_u64(reg->value, 0, reg->size);
+		target_addr_t start = value;
+
+		/* code is disassembled on both sides of the PC, stacks and
+		 * frames are walked upwards */
+		if (strcmp(name, "pc") == 0)
+			start -= MIN(value, mc->prefetch_window / 2);
+
+		/* only read memory known to exist: the window is cut to the
+		 * declared region holding the address, e.g. with the stack
+		 * pointer at the top of RAM, so a failed read is a real error */
+		struct memcache_region *region = memcache_find_region(mc, value, 1);
+		if (!region)
+			continue;
+
+		target_addr_t lo = MAX(PAGE_BASE(start), PAGE_BASE(region->address));
+		target_addr_t hi = MIN(PAGE_BASE(start + mc->prefetch_window - 1),
+				PAGE_BASE(region->address + region->size - 1)) + MEMCACHE_PAGE_SIZE;
+
+		LOG_DEBUG("prefetch %" PRIu32 " bytes at " TARGET_ADDR_FMT " (%s)",
+				(uint32_t)(hi - lo), lo, name);
+
+		if (memcache_read_pages(target, lo, hi - lo) == ERROR_OK)
+			mc->prefetch_bytes += hi - lo;
+	}
+
+	mc->prefetches++;
+}
+
+void memcache_free(struct target *target)
+{
+	struct memcache *mc = target->memcache;
+	struct memcache_region *region, *tmp;
+
+	if (!mc)
+		return;
+
+	memcache_drop(mc, false);
+	list_for_each_entry_safe(region, tmp, &mc->regions, lh) {
+		list_del(&region->lh);
+		free(region);
+	}
+	for (unsigned i = 0; i < mc->num_prefetch_regs; i++)
+		free(mc->prefetch_regs[i]);
+	free(mc);
+	target->memcache = NULL;
+}
+
+COMMAND_HANDLER(handle_memcache_prefetch_command)
+{
+	struct target *target = get_current_target(CMD_CTX);
+	struct memcache *mc = memcache_get(target);
+
+	if (!mc)
+		return ERROR_FAIL;
+
+	if (CMD_ARGC > 1 + MEMCACHE_MAX_PREFETCH_REGS)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (CMD_ARGC > 0) {
+		uint32_t window;
+		COMMAND_PARSE_NUMBER(u32, CMD_ARGV[0], window);
+		if (window > MEMCACHE_MAX_PREFETCH_WINDOW) {
+			command_print(CMD_CTX, "window must not exceed %d bytes",
+					MEMCACHE_MAX_PREFETCH_WINDOW);
+			return ERROR_COMMAND_ARGUMENT_INVALID;
+		}
+		mc->prefetch_window = window;
+
+		if (CMD_ARGC > 1 || mc->num_prefetch_regs == 0) {
+			for (unsigned i = 0; i < mc->num_prefetch_regs; i++)
+				free(mc->prefetch_regs[i]);
+			mc->num_prefetch_regs = 0;
+
+			if (CMD_ARGC > 1) {
+				for (unsigned i = 1; i < CMD_ARGC; i++)
+					mc->prefetch_regs[mc->num_prefetch_regs++] = strdup(CMD_ARGV[i]);
+			} else {
+				mc->prefetch_regs[mc->num_prefetch_regs++] = strdup("pc");
+				mc->prefetch_regs[mc->num_prefetch_regs++] = strdup("sp");
+			}
+		}
+
+		if (window == 0)
+			memcache_invalidate(target);
+	}
+
+	if (mc->prefetch_window == 0) {
+		command_print(CMD_CTX, "memcache prefetch disabled");
+		return ERROR_OK;
+	}
+
+	command_print(CMD_CTX, "memcache prefetch %" PRIu32 " bytes around:",
+			mc->prefetch_window);
+	for (unsigned i = 0; i < mc->num_prefetch_regs; i++)
+		command_print(CMD_CTX, "  %s", mc->prefetch_regs[i]);
+
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(handle_memcache_stats_command)
+{
+	struct target *target = get_current_target(CMD_CTX);
+	struct memcache *mc = target->memcache;
+
+	if (CMD_ARGC != 0)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (!mc) {
+		command_print(CMD_CTX, "memcache not in use");
+		return ERROR_OK;
+	}
+
+	uint64_t lookups = mc->hits + mc->misses;
+	command_print(CMD_CTX, "pages cached:  %u of %u (%u bytes each)",
+			mc->num_pages, mc->max_pages, MEMCACHE_PAGE_SIZE);
+	command_print(CMD_CTX, "hits:          %" PRIu64 " (%u%%)", mc->hits,
+			lookups ? (unsigned)(100 * mc->hits / lookups) : 0);
+	command_print(CMD_CTX, "misses:        %" PRIu64 " (%" PRIu64 " filled)",
+			mc->misses, mc->fills);
+	command_print(CMD_CTX, "evictions:     %" PRIu64, mc->evictions);
+	command_print(CMD_CTX, "prefetches:    %" PRIu64 " (%" PRIu64 " bytes)",
+			mc->prefetches, mc->prefetch_bytes);
+	command_print(CMD_CTX, "invalidations: %" PRIu64, mc->invalidations);
+
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(handle_memcache_reset_command)
+{
+	struct target *target = get_current_target(CMD_CTX);
+	struct memcache *mc = target->memcache;
+
+	if (CMD_ARGC != 0)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (!mc)
+		return ERROR_OK;
+
+	memcache_drop(mc, false);
+	mc->hits = 0;
+	mc->misses = 0;
+	mc->fills = 0;
+	mc->evictions = 0;
+	mc->prefetches = 0;
+	mc->prefetch_bytes = 0;
+	mc->invalidations = 0;
+
+	return ERROR_OK;
+}
+
+static const Jim_Nvp nvp_memcache_region_types[] = {
+	{ .name = "halted", .value = MEMCACHE_REGION_HALTED },
+	{ .name = "ro", .value = MEMCACHE_REGION_RO },
+	{ .name = NULL, .value = -1 },
+};
+
+COMMAND_HANDLER(handle_memcache_region_command)
+{
+	struct target *target = get_current_target(CMD_CTX);
+	struct memcache *mc = memcache_get(target);
+	struct memcache_region *region, *tmp;
+
+	if (!mc)
+		return ERROR_FAIL;
+
+	if (CMD_ARGC == 0) {
+		list_for_each_entry(region, &mc->regions, lh) {
+			command_print(CMD_CTX, TARGET_ADDR_FMT " 0x%8.8" PRIx32 " %s",
+					region->address, region->size,
+					Jim_Nvp_value2name_simple(nvp_memcache_region_types,
+						region->type)->name);
+		}
+		return ERROR_OK;
+	}
+
+	if (strcmp(CMD_ARGV[0], "clear") == 0) {
+		if (CMD_ARGC != 1)
+			return ERROR_COMMAND_SYNTAX_ERROR;
+		list_for_each_entry_safe(region, tmp, &mc->regions, lh) {
+			list_del(&region->lh);
+			free(region);
+		}
+		memcache_invalidate(target);
+		return ERROR_OK;
+	}
+
+	if (CMD_ARGC < 2 || CMD_ARGC > 3)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	target_addr_t address;
+	uint32_t size;
+	enum memcache_region_type type = MEMCACHE_REGION_HALTED;
+
+	COMMAND_PARSE_ADDRESS(CMD_ARGV[0], address);
+	COMMAND_PARSE_NUMBER(u32, CMD_ARGV[1], size);
+	if (size == 0 || address + size - 1 < address)
+		return ERROR_COMMAND_ARGUMENT_INVALID;
+
+	if (CMD_ARGC == 3) {
+		const Jim_Nvp *n = Jim_Nvp_name2value_simple(nvp_memcache_region_types,
+				CMD_ARGV[2]);
+		if (n->name == NULL)
+			return ERROR_COMMAND_SYNTAX_ERROR;
+		type = n->value;
+	}
+
+	region = malloc(sizeof(*region));
+	if (!region)
+		return ERROR_FAIL;
+
+	region->address = address;
+	region->size = size;
+	region->type = type;
+	list_add_tail(&region->lh, &mc->regions);
+
+	return ERROR_OK;
+}
+
+COMMAND_HANDLER(handle_memcache_size_command)
+{
+	struct target *target = get_current_target(CMD_CTX);
+	struct memcache *mc = memcache_get(target);
+
+	if (!mc)
+		return ERROR_FAIL;
+
+	if (CMD_ARGC > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (CMD_ARGC == 1) {
+		unsigned max_pages;
+		COMMAND_PARSE_NUMBER(uint, CMD_ARGV[0], max_pages);
+		if (max_pages == 0)
+			return ERROR_COMMAND_ARGUMENT_INVALID;
+		mc->max_pages = max_pages;
+		while (mc->num_pages > mc->max_pages) {
+			memcache_drop_page(mc,
+				list_entry(mc->pages.prev, struct memcache_page, lh));
+			mc->evictions++;
+		}
+	}
+
+	command_print(CMD_CTX, "memcache size %u pages (%u bytes)",
+			mc->max_pages, mc->max_pages * MEMCACHE_PAGE_SIZE);
+
+	return ERROR_OK;
+}
+
+static const struct command_registration memcache_subcommand_handlers[] = {
+	{
+		.name = "prefetch",
+		.handler = handle_memcache_prefetch_command,
+		.mode = COMMAND_ANY,
+		.help = "Prefetch memory around the given registers when the "
+			"current target halts. A window of 0 disables prefetching.",
+		.usage = "[window_bytes [register ...]]",
+	},
+	{
+		.name = "region",
+		.handler = handle_memcache_region_command,
+		.mode = COMMAND_ANY,
+		.help = "Declare a cacheable memory region of the current target, "
+			"list the regions without arguments. 'ro' regions (flash, ROM) "
+			"are cached even while the target runs, 'halted' ones only "
+			"while it is halted.",
+		.usage = "[address size ['halted'|'ro']] | ['clear']",
+	},
+	{
+		.name = "size",
+		.handler = handle_memcache_size_command,
+		.mode = COMMAND_ANY,
+		.help = "Set the maximum number of cached pages.",
+		.usage = "[pages]",
+	},
+	{
+		.name = "stats",
+		.handler = handle_memcache_stats_command,
+		.mode = COMMAND_EXEC,
+		.help = "Display memory cache statistics of the current target.",
+		.usage = "",
+	},
+	{
+		.name = "reset",
+		.handler = handle_memcache_reset_command,
+		.mode = COMMAND_EXEC,
+		.help = "Drop all cached memory and clear the statistics.",
+		.usage = "",
+	},
+	COMMAND_REGISTRATION_DONE
+};
+
+const struct command_registration memcache_command_handlers[] = {
+	{
+		.name = "memcache",
+		.mode = COMMAND_ANY,
+		.help = "host side cache of target memory",
+		.usage = "",
+		.chain = memcache_subcommand_handlers,
+	},
+	COMMAND_REGISTRATION_DONE
+};
@@ -0,0 +1,100 @@
+/***************************************************************************
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+#ifndef OPENOCD_TARGET_MEMCACHE_H
+#define OPENOCD_TARGET_MEMCACHE_H
+
+#include <helper/command.h>
+#include <helper/list.h>
+#include <helper/types.h>
+
+struct target;
+
+#define MEMCACHE_PAGE_SIZE			64
+#define MEMCACHE_DEFAULT_MAX_PAGES	1024
+#define MEMCACHE_MAX_PREFETCH_REGS	4
+#define MEMCACHE_HASH_SIZE			1024	/* buckets, a power of two */
+
+enum memcache_region_type {
+	MEMCACHE_REGION_HALTED,			/* RAM, cacheable while halted */
+	MEMCACHE_REGION_RO,				/* flash/ROM, cacheable while running */
+};
+
+struct memcache_region {
+	struct list_head lh;
+	target_addr_t address;
+	uint32_t size;
+	enum memcache_region_type type;
+};
+
+struct memcache_page {
+	struct list_head lh;			/* LRU order, most recent first */
+	struct hlist_node hash;			/* lookup by address */
+	target_addr_t address;			/* aligned to MEMCACHE_PAGE_SIZE */
+	bool persistent;				/* survives resume, from a read-only region */
+	uint8_t data[MEMCACHE_PAGE_SIZE];
+};
+
+/**
+ * Host side copy of target memory. Pages come from the halt-time prefetch
+ * or from reads of user declared regions. Read-only regions (flash, ROM)
+ * stay cached while the target runs; everything else is only used while
+ * halted and dropped on resume. Writes through OpenOCD, flash programming,
+ * algorithms and reset invalidate the affected pages.
+ */
+struct memcache {
+	struct list_head pages;
+	struct hlist_head hash[MEMCACHE_HASH_SIZE];
+	unsigned num_pages;
+	unsigned max_pages;
+	bool filling;					/* bypass lookups while refilling */
+
+	struct list_head regions;
+
+	/* halt-time prefetch, window of 0 disables it */
+	uint32_t prefetch_window;
+	unsigned num_prefetch_regs;
+	char *prefetch_regs[MEMCACHE_MAX_PREFETCH_REGS];
+
+	/* statistics */
+	uint64_t hits;
+	uint64_t misses;
+	uint64_t fills;
+	uint64_t evictions;
+	uint64_t prefetches;
+	uint64_t prefetch_bytes;
+	uint64_t invalidations;
+};
+
+/**
+ * Try to serve a read from the cache, filling it first if the range lies
+ * in a cacheable region.
+ * @returns true if all @a count bytes were copied to @a buffer.
+ */
+bool memcache_read(struct target *target, target_addr_t address,
+		uint32_t count, uint8_t *buffer);
+/** Drop everything, e.g. before an algorithm runs or on reset. */
+void memcache_invalidate(struct target *target);
+/** Drop the pages that are only valid while halted. */
+void memcache_invalidate_volatile(struct target *target);
+void memcache_invalidate_range(struct target *target,
+		target_addr_t address, uint32_t count);
+/** Refill the cache around the configured registers after a halt. */
+void memcache_prefetch(struct target *target);
+void memcache_free(struct target *target);
+
+extern const struct command_registration memcache_command_handlers[];
+
+#endif /* OPENOCD_TARGET_MEMCACHE_H */
@@ -1003,6 +1003,7 @@ static int riscv_run_algorithm(struct target *target, int num_mem_params,
 	if (oldriscv_resume(target, 0, entry_point, 0, 0) != ERROR_OK)
 		return ERROR_FAIL;
 
+	bool timed_out = false;
 	int64_t start = timeval_ms();
 	while (target->state != TARGET_HALTED) {
 		LOG_DEBUG("poll()");
@@ -1013,7 +1014,11 @@ static int riscv_run_algorithm(struct target *target, int num_mem_params,
 			LOG_ERROR("  start = 0x%08x", (uint32_t) start);
 			oldriscv_halt(target);
 			old_or_new_riscv_poll(target);
-			return ERROR_TARGET_TIMEOUT;
+			/* the caller may retry, so give the hart its state back */
+			if (target->state != TARGET_HALTED)
+				return ERROR_TARGET_TIMEOUT;
+			timed_out = true;
+			break;
 		}
 
 		int result = old_or_new_riscv_poll(target);
@@ -1021,13 +1026,25 @@ static int riscv_run_algorithm(struct target *target, int num_mem_params,
 			return result;
 	}
 
-	if (reg_pc->type->get(reg_pc) != ERROR_OK)
-		return ERROR_FAIL;
-	uint64_t final_pc = buf_get_u64(reg_pc->value, 0, reg_pc->size);
-	if (final_pc != exit_point) {
-		LOG_ERROR("PC ended up at 0x%" PRIx64 " instead of 0x%"
-				TARGET_PRIxADDR, final_pc, exit_point);
-		return ERROR_FAIL;
+	if (!timed_out) {
+		if (reg_pc->type->get(reg_pc) != ERROR_OK)
+			return ERROR_FAIL;
+		uint64_t final_pc = buf_get_u64(reg_pc->value, 0, reg_pc->size);
+		if (final_pc != exit_point) {
+			LOG_ERROR("PC ended up at 0x%" PRIx64 " instead of 0x%"
+					TARGET_PRIxADDR, final_pc, exit_point);
+			return ERROR_FAIL;
+		}
+
+		/* Collect results */
+		for (int i = 0; i < num_reg_params; i++) {
+			if (reg_params[i].direction == PARAM_OUT)
+				continue;
+			struct reg *r = register_get_by_name(target->reg_cache, reg_params[i].reg_name, 0);
+			if (r->type->get(r) != ERROR_OK)
+				return ERROR_FAIL;
+			buf_cpy(r->value, reg_params[i].value, reg_params[i].size);
+		}
 	}
 
 	/* Restore Interrupts */
@@ -1049,19 +1066,202 @@ static int riscv_run_algorithm(struct target *target, int num_mem_params,
 			return ERROR_FAIL;
 	}
 
-	return ERROR_OK;
+	return timed_out ? ERROR_TARGET_TIMEOUT : ERROR_OK;
 }
 
-/* Should run code on the target to perform CRC of
-memory. Not yet implemented.
-*/
-
+/* Run code on the target to perform CRC of memory. */
 static int riscv_checksum_memory(struct target *target,
 		target_addr_t address, uint32_t count,
 		uint32_t *checksum)
 {
-	*checksum = 0xFFFFFFFF;
-	return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
+	struct working_area *crc_algorithm;
+	struct reg_param reg_params[3];
+	int retval;
+
+	static const uint8_t riscv_crc_code[] = {
+#include "../../../contrib/loaders/checksum/riscv_crc.inc"
+	};
+
+	/* the loader is RV32 code */
+	if (riscv_xlen(target) != 32)
+		return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
+
+	/* code followed by the 1 KiB lookup table it builds */
+	retval = target_alloc_working_area(target, sizeof(riscv_crc_code) + 1024,
+			&crc_algorithm);
+	if (retval != ERROR_OK)
+		return retval;
+
+	retval = target_write_buffer(target, crc_algorithm->address,
+			sizeof(riscv_crc_code), riscv_crc_code);
+	if (retval != ERROR_OK)
+		goto cleanup;
+
+	init_reg_param(&reg_params[0], "a0", 32, PARAM_IN_OUT);
+	init_reg_param(&reg_params[1], "a1", 32, PARAM_OUT);
+	init_reg_param(&reg_params[2], "a2", 32, PARAM_OUT);
+
+	buf_set_u32(reg_params[0].value, 0, 32, address);
+	buf_set_u32(reg_params[1].value, 0, 32, count);
+	buf_set_u32(reg_params[2].value, 0, 32,
+			crc_algorithm->address + sizeof(riscv_crc_code));
+
+	int timeout = 20000 * (1 + (count / (1024 * 1024)));
+
+	retval = target_run_algorithm(target, 0, NULL, 3, reg_params,
+			crc_algorithm->address,
+			crc_algorithm->address + (sizeof(riscv_crc_code) - 4),
+			timeout, NULL);
+
+	if (retval == ERROR_OK)
+		*checksum = buf_get_u32(reg_params[0].value, 0, 32);
+	else
+		LOG_ERROR("error executing RISC-V crc algorithm");
+
+	destroy_reg_param(&reg_params[0]);
+	destroy_reg_param(&reg_params[1]);
+	destroy_reg_param(&reg_params[2]);
+
+cleanup:
+	target_free_working_area(target, crc_algorithm);
+
+	return retval;
+}
+
+/* Run code on the target to check memory blocks are erased.
+ * Returns the number of blocks checked. */
+static int riscv_blank_check_memory(struct target *target,
+		struct target_memory_check_block *blocks, int num_blocks,
+		uint8_t erased_value)
+{
+	struct working_area *erase_check_algorithm;
+	struct working_area *erase_check_params;
+	struct reg_param reg_params[2];
+	int retval;
+
+	static bool timed_out;
+
+	static const uint8_t erase_check_code[] = {
+#include "../../../contrib/loaders/erase_check/riscv_erase_check.inc"
+	};
+
+	const uint32_t code_size = sizeof(erase_check_code);
+
+	if (riscv_xlen(target) != 32)
+		return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
+
+	/* make sure we have a working area */
+	if (target_alloc_working_area(target, code_size,
+			&erase_check_algorithm) != ERROR_OK)
+		return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
+
+	retval = target_write_buffer(target, erase_check_algorithm->address,
+			code_size, erase_check_code);
+	if (retval != ERROR_OK)
+		goto cleanup1;
+
+	/* prepare blocks array for algo */
+	struct algo_block {
+		union {
+			uint32_t size;
+			uint32_t result;
+		};
+		uint32_t address;
+	};
+
+	uint32_t avail = target_get_working_area_avail(target);
+	int blocks_to_check = avail / sizeof(struct algo_block) - 1;
+	if (num_blocks < blocks_to_check)
+		blocks_to_check = num_blocks;
+	if (blocks_to_check < 1) {
+		retval = ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
+		goto cleanup1;
+	}
+
+	struct algo_block *params = malloc((blocks_to_check + 1) * sizeof(struct algo_block));
+	if (params == NULL) {
+		retval = ERROR_FAIL;
+		goto cleanup1;
+	}
+
+	int i;
+	uint32_t total_size = 0;
+	for (i = 0; i < blocks_to_check; i++) {
+		total_size += blocks[i].size;
+		target_buffer_set_u32(target, (uint8_t *)&(params[i].size),
+				blocks[i].size / sizeof(uint32_t));
+		target_buffer_set_u32(target, (uint8_t *)&(params[i].address),
+				blocks[i].address);
+	}
+	target_buffer_set_u32(target, (uint8_t *)&(params[blocks_to_check].size), 0);
+
+	uint32_t param_size = (blocks_to_check + 1) * sizeof(struct algo_block);
+	if (target_alloc_working_area(target, param_size,
+			&erase_check_params) != ERROR_OK) {
+		retval = ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
+		goto cleanup2;
+	}
+
+	retval = target_write_buffer(target, erase_check_params->address,
+			param_size, (uint8_t *)params);
+	if (retval != ERROR_OK)
+		goto cleanup3;
+
+	uint32_t erased_word = erased_value | (erased_value << 8)
+			| (erased_value << 16) | (erased_value << 24);
+
+	LOG_DEBUG("Starting erase check of %d blocks, parameters@"
+			TARGET_ADDR_FMT, blocks_to_check, erase_check_params->address);
+
+	init_reg_param(&reg_params[0], "a0", 32, PARAM_OUT);
+	buf_set_u32(reg_params[0].value, 0, 32, erase_check_params->address);
+
+	init_reg_param(&reg_params[1], "a1", 32, PARAM_OUT);
+	buf_set_u32(reg_params[1].value, 0, 32, erased_word);
+
+	/* assume CPU clk at least 1 MHz */
+	int timeout = (timed_out ? 30000 : 2000) + total_size * 3 / 1000;
+
+	retval = target_run_algorithm(target, 0, NULL,
+			ARRAY_SIZE(reg_params), reg_params,
+			erase_check_algorithm->address,
+			erase_check_algorithm->address + (code_size - 4),
+			timeout, NULL);
+
+	timed_out = retval == ERROR_TARGET_TIMEOUT;
+	if (retval != ERROR_OK && !timed_out)
+		goto cleanup4;
+
+	retval = target_read_buffer(target, erase_check_params->address,
+			param_size, (uint8_t *)params);
+	if (retval != ERROR_OK)
+		goto cleanup4;
+
+	for (i = 0; i < blocks_to_check; i++) {
+		uint32_t result = target_buffer_get_u32(target,
+				(uint8_t *)&(params[i].result));
+		if (result != 0 && result != 1)
+			break;
+
+		blocks[i].result = result;
+	}
+	if (i && timed_out)
+		LOG_INFO("Slow CPU clock: %d blocks checked, %d remain. Continuing...", i, num_blocks - i);
+
+	retval = i;		/* return number of blocks really checked */
+
+cleanup4:
+	destroy_reg_param(&reg_params[0]);
+	destroy_reg_param(&reg_params[1]);
+
+cleanup3:
+	target_free_working_area(target, erase_check_params);
+cleanup2:
+	free(params);
+cleanup1:
+	target_free_working_area(target, erase_check_algorithm);
+
+	return retval;
 }
 
 /*** OpenOCD Helper Functions ***/
@@ -1771,6 +1971,7 @@ struct target_type riscv_target = {
 	.write_memory = riscv_write_memory,
 
 	.checksum_memory = riscv_checksum_memory,
+	.blank_check_memory = riscv_blank_check_memory,
 
 	.get_gdb_reg_list = riscv_get_gdb_reg_list,
 
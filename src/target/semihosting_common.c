@@ -52,6 +52,11 @@
 #include <helper/log.h>
 #include <sys/stat.h>
 
+/* SYS_WRITE0 strings are read in aligned chunks of this size */
+#define SEMIHOSTING_STRING_CHUNK	64
+/* pending console output is written out at least this often */
+#define SEMIHOSTING_FLUSH_MS		50
+
 static const int open_modeflags[12] = {
 	O_RDONLY,
 	O_RDONLY | O_BINARY,
@@ -72,6 +77,8 @@ static int semihosting_common_fileio_info(struct target *target,
 static int semihosting_common_fileio_end(struct target *target, int result,
 	int fileio_errno, bool ctrl_c);
 
+static void semihosting_out(struct target *target, int fd,
+	const uint8_t *data, size_t len);
 static int semihosting_read_fields(struct target *target, size_t number,
 	uint8_t *fields);
 static int semihosting_write_fields(struct target *target, size_t number,
@@ -121,6 +128,9 @@ int semihosting_common_init(struct target *target, void *setup,
 	semihosting->result = -1;
 	semihosting->sys_errno = -1;
 	semihosting->cmdline = NULL;
+	semihosting->out_len = 0;
+	semihosting->out_fd = -1;
+	semihosting->out_timer = false;
 
 	/* If possible, update it in setup(). */
 	semihosting->setup_time = clock();
@@ -168,6 +178,12 @@ int semihosting_common(struct target *target)
 	LOG_DEBUG("op=0x%x, param=0x%" PRIx64, (int)semihosting->op,
 		semihosting->param);
 
+	/* keep console output in order with everything else the target does */
+	if (semihosting->op != SEMIHOSTING_SYS_WRITE &&
+			semihosting->op != SEMIHOSTING_SYS_WRITEC &&
+			semihosting->op != SEMIHOSTING_SYS_WRITE0)
+		semihosting_common_flush(target);
+
 	switch (semihosting->op) {
 
 		case SEMIHOSTING_SYS_CLOCK:	/* 0x10 */
@@ -1152,6 +1168,13 @@ int semihosting_common(struct target *target)
 							free(buf);
 							return retval;
 						}
+						if (fd == STDOUT_FILENO || fd == STDERR_FILENO) {
+							semihosting_out(target, fd, buf, len);
+							semihosting->result = 0;
+							free(buf);
+							break;
+						}
+						semihosting_common_flush(target);
 						semihosting->result = write(fd, buf, len);
 						semihosting->sys_errno = errno;
 						LOG_DEBUG("write(%d, 0x%" PRIx64 ", %zu)=%d",
@@ -1197,7 +1220,7 @@ int semihosting_common(struct target *target)
 				retval = target_read_memory(target, addr, 1, 1, &c);
 				if (retval != ERROR_OK)
 					return retval;
-				putchar(c);
+				semihosting_out(target, STDOUT_FILENO, &c, 1);
 				semihosting->result = 0;
 			}
 			break;
@@ -1215,37 +1238,43 @@ int semihosting_common(struct target *target)
 			 * Return
 			 * None. The RETURN REGISTER is corrupted.
 			 */
-			if (semihosting->is_fileio) {
-				size_t count = 0;
-				uint64_t addr = semihosting->param;
-				for (;; addr++) {
-					unsigned char c;
-					retval = target_read_memory(target, addr, 1, 1, &c);
-					if (retval != ERROR_OK)
-						return retval;
-					if (c == '\0')
-						break;
-					count++;
+		{
+			size_t count = 0;
+			uint64_t addr = semihosting->param;
+			uint8_t buf[SEMIHOSTING_STRING_CHUNK];
+			bool done = false;
+
+			/* read whole aligned chunks, they cannot cross into
+			 * a different memory region */
+			while (!done) {
+				size_t len = SEMIHOSTING_STRING_CHUNK -
+					(addr % SEMIHOSTING_STRING_CHUNK);
+				retval = target_read_buffer(target, addr, len, buf);
+				if (retval != ERROR_OK)
+					return retval;
+
+				uint8_t *nul = memchr(buf, '\0', len);
+				if (nul) {
+					len = nul - buf;
+					done = true;
 				}
+				if (!semihosting->is_fileio)
+					semihosting_out(target, STDOUT_FILENO, buf, len);
+				count += len;
+				addr += len;
+			}
+
+			if (semihosting->is_fileio) {
 				semihosting->hit_fileio = true;
 				fileio_info->identifier = "write";
 				fileio_info->param_1 = 1;
 				fileio_info->param_2 = semihosting->param;
 				fileio_info->param_3 = count;
 			} else {
-				uint64_t addr = semihosting->param;
-				do {
-					unsigned char c;
-					retval = target_read_memory(target, addr++, 1, 1, &c);
-					if (retval != ERROR_OK)
-						return retval;
-					if (!c)
-						break;
-					putchar(c);
-				} while (1);
 				semihosting->result = 0;
 			}
-			break;
+		}
+		break;
 
 		case SEMIHOSTING_SYS_ELAPSED:	/* 0x30 */
 		/*
@@ -1404,6 +1433,70 @@ static int semihosting_common_fileio_end(struct target *target, int result,
 	return semihosting->post_result(target);
 }
 
+static int semihosting_flush_timer(void *priv)
+{
+	return semihosting_common_flush(priv);
+}
+
+/**
+ * Write out the console output collected from the target.
+ */
+int semihosting_common_flush(struct target *target)
+{
+	struct semihosting *semihosting = target->semihosting;
+	size_t done = 0;
+
+	if (!semihosting)
+		return ERROR_OK;
+
+	while (done < semihosting->out_len) {
+		ssize_t n = write(semihosting->out_fd, semihosting->out_buf + done,
+				semihosting->out_len - done);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			LOG_ERROR("semihosting: console write failed: %s",
+				strerror(errno));
+			break;
+		}
+		done += n;
+	}
+	semihosting->out_len = 0;
+
+	return ERROR_OK;
+}
+
+/**
+ * Collect console output, so that many small writes by the target
+ * reach the host as one. It is written out when the buffer is full,
+ * before any other semihosting operation and by a periodic timer.
+ */
+static void semihosting_out(struct target *target, int fd,
+	const uint8_t *data, size_t len)
+{
+	struct semihosting *semihosting = target->semihosting;
+
+	if (semihosting->out_len && semihosting->out_fd != fd)
+		semihosting_common_flush(target);
+	semihosting->out_fd = fd;
+
+	while (len) {
+		size_t n = MIN(len, sizeof(semihosting->out_buf) - semihosting->out_len);
+		memcpy(semihosting->out_buf + semihosting->out_len, data, n);
+		semihosting->out_len += n;
+		data += n;
+		len -= n;
+		if (semihosting->out_len == sizeof(semihosting->out_buf))
+			semihosting_common_flush(target);
+	}
+
+	if (!semihosting->out_timer) {
+		target_register_timer_callback(semihosting_flush_timer,
+			SEMIHOSTING_FLUSH_MS, 1, target);
+		semihosting->out_timer = true;
+	}
+}
+
 /**
  * Read all fields of a command from target to buffer.
  */
@@ -88,6 +88,9 @@ enum semihosting_reported_exceptions {
 	ADP_STOPPED_RUN_TIME_ERROR = ((2 << 16) + 35),
 };
 
+/* console output collected before it is written to the host */
+#define SEMIHOSTING_OUT_BUF_SIZE	1024
+
 struct target;
 
 /*
@@ -152,6 +155,14 @@ struct semihosting {
 	/** The current time when 'execution starts' */
 	clock_t setup_time;
 
+	/** Console output not yet written to the host, and its descriptor. */
+	uint8_t out_buf[SEMIHOSTING_OUT_BUF_SIZE];
+	size_t out_len;
+	int out_fd;
+
+	/** A flag reporting whether the output flush timer is registered. */
+	bool out_timer;
+
 	int (*setup)(struct target *target, int enable);
 	int (*post_result)(struct target *target);
 };
@@ -159,5 +170,6 @@ struct semihosting {
 int semihosting_common_init(struct target *target, void *setup,
 	void *post_result);
 int semihosting_common(struct target *target);
+int semihosting_common_flush(struct target *target);
 
 #endif	/* OPENOCD_TARGET_SEMIHOSTING_COMMON_H */
@@ -48,6 +48,7 @@
 #include "target.h"
 #include "target_type.h"
 #include "target_request.h"
+#include "memcache.h"
 #include "breakpoints.h"
 #include "register.h"
 #include "trace.h"
@@ -55,6 +56,7 @@
 #include "rtos/rtos.h"
 #include "transport/transport.h"
 #include "arm_cti.h"
+#include "semihosting_common.h"
 
 /* default halt wait timeout (ms) */
 #define DEFAULT_HALT_TIMEOUT 5000
@@ -625,6 +627,8 @@ int target_resume(struct target *target, int current, target_addr_t address,
 
 	target_call_event_callbacks(target, TARGET_EVENT_RESUME_START);
 
+	memcache_invalidate_volatile(target);
+
 	/* note that resume *must* be asynchronous. The CPU can halt before
 	 * we poll. The CPU can even halt at the current PC as a result of
 	 * a software breakpoint being inserted by (a bug?) the application.
@@ -650,8 +654,10 @@ static int target_process_reset(struct command_context *cmd_ctx, enum target_res
 	}
 
 	struct target *target;
-	for (target = all_targets; target; target = target->next)
+	for (target = all_targets; target; target = target->next) {
+		memcache_invalidate(target);
 		target_call_reset_callbacks(target, reset_mode);
+	}
 
 	/* disable polling during reset to make reset event scripts
 	 * more predictable, i.e. dr/irscan & pathmove in events will
@@ -809,6 +815,8 @@ int target_run_algorithm(struct target *target,
 		goto done;
 	}
 
+	memcache_invalidate(target);
+
 	target->running_alg = true;
 	retval = target->type->run_algorithm(target,
 			num_mem_params, mem_params,
@@ -848,6 +856,8 @@ int target_start_algorithm(struct target *target,
 		goto done;
 	}
 
+	memcache_invalidate(target);
+
 	target->running_alg = true;
 	retval = target->type->start_algorithm(target,
 			num_mem_params, mem_params,
@@ -1092,6 +1102,8 @@ int target_read_memory(struct target *target,
 		LOG_ERROR("Target %s doesn't support read_memory", target_name(target));
 		return ERROR_FAIL;
 	}
+	if (memcache_read(target, address, size * count, buffer))
+		return ERROR_OK;
 	return target->type->read_memory(target, address, size, count, buffer);
 }
 
@@ -1120,6 +1132,7 @@ int target_write_memory(struct target *target,
 		LOG_ERROR("Target %s doesn't support write_memory", target_name(target));
 		return ERROR_FAIL;
 	}
+	memcache_invalidate_range(target, address, size * count);
 	return target->type->write_memory(target, address, size, count, buffer);
 }
 
@@ -1134,6 +1147,8 @@ int target_write_phys_memory(struct target *target,
 		LOG_ERROR("Target %s doesn't support write_phys_memory", target_name(target));
 		return ERROR_FAIL;
 	}
+	/* the cache holds virtual addresses, the mapping is unknown here */
+	memcache_invalidate(target);
 	return target->type->write_phys_memory(target, address, size, count, buffer);
 }
 
@@ -1231,6 +1246,7 @@ bool target_supports_gdb_connection(struct target *target)
 int target_step(struct target *target,
 		int current, target_addr_t address, int handle_breakpoints)
 {
+	memcache_invalidate_volatile(target);
 	return target->type->step(target, current, address, handle_breakpoints);
 }
 
@@ -1567,6 +1583,9 @@ int target_call_event_callbacks(struct target *target, enum target_event event)
 	struct target_event_callback *next_callback;
 
 	if (event == TARGET_EVENT_HALTED) {
+		/* refill the memory cache before GDB starts asking */
+		memcache_prefetch(target);
+
 		/* execute early halted first */
 		target_call_event_callbacks(target, TARGET_EVENT_GDB_HALT);
 	}
@@ -1920,8 +1939,12 @@ static void target_destroy(struct target *target)
 	if (target->type->deinit_target)
 		target->type->deinit_target(target);
 
-	if (target->semihosting)
+	if (target->semihosting) {
+		semihosting_common_flush(target);
 		free(target->semihosting);
+	}
+
+	memcache_free(target);
 
 	jtag_unregister_event_callback(jtag_enable_callback, target);
 
@@ -2144,6 +2167,7 @@ int target_write_buffer(struct target *target, target_addr_t address, uint32_t s
 		return ERROR_FAIL;
 	}
 
+	memcache_invalidate_range(target, address, size);
 	return target->type->write_buffer(target, address, size, buffer);
 }
 
@@ -2206,6 +2230,9 @@ int target_read_buffer(struct target *target, target_addr_t address, uint32_t si
 		return ERROR_FAIL;
 	}
 
+	if (memcache_read(target, address, size, buffer))
+		return ERROR_OK;
+
 	return target->type->read_buffer(target, address, size, buffer);
 }
 
@@ -4508,6 +4535,185 @@ static int target_array2mem(Jim_Interp *interp, struct target *target,
 	return e;
 }
 
+/* largest single read_memory/write_memory transfer */
+#define TARGET_RW_MEMORY_MAX	(16 * 1024 * 1024)
+
+static int target_rw_memory_phys(struct target *target, target_addr_t addr,
+		uint32_t count, uint8_t *buffer, bool is_write)
+{
+	while (count > 0) {
+		uint32_t width = 1;
+		if ((addr & 3) == 0 && count >= 4)
+			width = 4;
+		else if ((addr & 1) == 0 && count >= 2)
+			width = 2;
+
+		/* narrow accesses only up to the next word boundary */
+		uint32_t n = MIN(count / width, 1024u);
+		if (width < 4 && count >= 4)
+			n = MIN(n, (4 - (addr & 3)) / width);
+
+		int retval;
+		if (is_write)
+			retval = target_write_phys_memory(target, addr, width, n, buffer);
+		else
+			retval = target_read_phys_memory(target, addr, width, n, buffer);
+		if (retval != ERROR_OK)
+			return retval;
+
+		addr += n * width;
+		buffer += n * width;
+		count -= n * width;
+	}
+	return ERROR_OK;
+}
+
+static int target_parse_rw_memory_args(Jim_Interp *interp, int argc,
+		Jim_Obj *const *argv, target_addr_t *addr, bool *is_phys)
+{
+	jim_wide w;
+	int e = Jim_GetWide(interp, argv[0], &w);
+	if (e != JIM_OK)
+		return e;
+	*addr = w;
+
+	*is_phys = false;
+	if (argc > 2) {
+		if (strcmp(Jim_String(argv[2]), "phys") != 0) {
+			Jim_SetResultString(interp, "expected 'phys'", -1);
+			return JIM_ERR;
+		}
+		*is_phys = true;
+	}
+	return JIM_OK;
+}
+
+/* read_memory address count [phys]: returns the bytes as one Jim string,
+ * without the per-element conversion mem2array does */
+static int target_read_memory_jim(Jim_Interp *interp, struct target *target,
+		int argc, Jim_Obj *const *argv)
+{
+	target_addr_t addr;
+	bool is_phys;
+	jim_wide count;
+
+	if (argc < 2 || argc > 3) {
+		Jim_WrongNumArgs(interp, 0, argv, "address count [phys]");
+		return JIM_ERR;
+	}
+	int e = target_parse_rw_memory_args(interp, argc, argv, &addr, &is_phys);
+	if (e != JIM_OK)
+		return e;
+	e = Jim_GetWide(interp, argv[1], &count);
+	if (e != JIM_OK)
+		return e;
+	if (count <= 0 || count > TARGET_RW_MEMORY_MAX) {
+		Jim_SetResultString(interp, "read_memory: invalid count", -1);
+		return JIM_ERR;
+	}
+
+	uint8_t *buffer = malloc(count);
+	if (buffer == NULL) {
+		Jim_SetResultString(interp, "read_memory: out of memory", -1);
+		return JIM_ERR;
+	}
+
+	int retval;
+	if (is_phys)
+		retval = target_rw_memory_phys(target, addr, count, buffer, false);
+	else
+		retval = target_read_buffer(target, addr, count, buffer);
+	if (retval != ERROR_OK) {
+		LOG_ERROR("read_memory: Read @ " TARGET_ADDR_FMT ", cnt=%" PRId64 ", failed",
+				addr, (int64_t)count);
+		free(buffer);
+		Jim_SetResultString(interp, "read_memory: cannot read memory", -1);
+		return JIM_ERR;
+	}
+
+	Jim_SetResult(interp, Jim_NewStringObj(interp, (const char *)buffer, count));
+	free(buffer);
+	return JIM_OK;
+}
+
+/* write_memory address data [phys]: data is a byte string, e.g. from
+ * read_memory or a binary tcl server request */
+static int target_write_memory_jim(Jim_Interp *interp, struct target *target,
+		int argc, Jim_Obj *const *argv)
+{
+	target_addr_t addr;
+	bool is_phys;
+	int len;
+
+	if (argc < 2 || argc > 3) {
+		Jim_WrongNumArgs(interp, 0, argv, "address data [phys]");
+		return JIM_ERR;
+	}
+	int e = target_parse_rw_memory_args(interp, argc, argv, &addr, &is_phys);
+	if (e != JIM_OK)
+		return e;
+
+	const char *data = Jim_GetString(argv[1], &len);
+	if (len > TARGET_RW_MEMORY_MAX) {
+		Jim_SetResultString(interp, "write_memory: data too long", -1);
+		return JIM_ERR;
+	}
+	if (len == 0)
+		return JIM_OK;
+
+	/* the string belongs to the object, the target API wants it writable */
+	uint8_t *buffer = malloc(len);
+	if (buffer == NULL) {
+		Jim_SetResultString(interp, "write_memory: out of memory", -1);
+		return JIM_ERR;
+	}
+	memcpy(buffer, data, len);
+
+	int retval;
+	if (is_phys)
+		retval = target_rw_memory_phys(target, addr, len, buffer, true);
+	else
+		retval = target_write_buffer(target, addr, len, buffer);
+	free(buffer);
+	if (retval != ERROR_OK) {
+		LOG_ERROR("write_memory: Write @ " TARGET_ADDR_FMT ", cnt=%d, failed",
+				addr, len);
+		Jim_SetResultString(interp, "write_memory: cannot write memory", -1);
+		return JIM_ERR;
+	}
+
+	Jim_SetResult(interp, Jim_NewEmptyStringObj(interp));
+	return JIM_OK;
+}
+
+static int jim_read_memory(Jim_Interp *interp, int argc, Jim_Obj *const *argv)
+{
+	struct command_context *context = current_command_context(interp);
+	assert(context != NULL);
+
+	struct target *target = get_current_target(context);
+	if (target == NULL) {
+		LOG_ERROR("read_memory: no current target");
+		return JIM_ERR;
+	}
+
+	return target_read_memory_jim(interp, target, argc - 1, argv + 1);
+}
+
+static int jim_write_memory(Jim_Interp *interp, int argc, Jim_Obj *const *argv)
+{
+	struct command_context *context = current_command_context(interp);
+	assert(context != NULL);
+
+	struct target *target = get_current_target(context);
+	if (target == NULL) {
+		LOG_ERROR("write_memory: no current target");
+		return JIM_ERR;
+	}
+
+	return target_write_memory_jim(interp, target, argc - 1, argv + 1);
+}
+
 /* FIX? should we propagate errors here rather than printing them
  * and continuing?
  */
@@ -5147,6 +5353,20 @@ static int jim_target_array2mem(Jim_Interp *interp,
 	return target_array2mem(interp, target, argc - 1, argv + 1);
 }
 
+static int jim_target_read_memory(Jim_Interp *interp,
+		int argc, Jim_Obj *const *argv)
+{
+	struct target *target = Jim_CmdPrivData(interp);
+	return target_read_memory_jim(interp, target, argc - 1, argv + 1);
+}
+
+static int jim_target_write_memory(Jim_Interp *interp,
+		int argc, Jim_Obj *const *argv)
+{
+	struct target *target = Jim_CmdPrivData(interp);
+	return target_write_memory_jim(interp, target, argc - 1, argv + 1);
+}
+
 static int jim_target_tap_disabled(Jim_Interp *interp)
 {
 	Jim_SetResultFormatted(interp, "[TAP is disabled]");
@@ -5471,6 +5691,20 @@ static const struct command_registration target_instance_command_handlers[] = {
 			"from target memory",
 		.usage = "arrayname bitwidth address count",
 	},
+	{
+		.name = "read_memory",
+		.mode = COMMAND_EXEC,
+		.jim_handler = jim_target_read_memory,
+		.help = "Returns target memory as a binary string",
+		.usage = "address count ['phys']",
+	},
+	{
+		.name = "write_memory",
+		.mode = COMMAND_EXEC,
+		.jim_handler = jim_target_write_memory,
+		.help = "Writes a binary string to target memory",
+		.usage = "address data ['phys']",
+	},
 	{
 		.name = "eventlist",
 		.mode = COMMAND_EXEC,
@@ -6082,6 +6316,9 @@ static const struct command_registration target_command_handlers[] = {
 
 		.chain = target_subcommand_handlers,
 	},
+	{
+		.chain = memcache_command_handlers,
+	},
 	COMMAND_REGISTRATION_DONE
 };
 
@@ -6541,6 +6778,20 @@ static const struct command_registration target_exec_command_handlers[] = {
 			"and write the 8/16/32 bit values",
 		.usage = "arrayname bitwidth address count",
 	},
+	{
+		.name = "read_memory",
+		.mode = COMMAND_EXEC,
+		.jim_handler = jim_read_memory,
+		.help = "read target memory and return it as a binary string",
+		.usage = "address count ['phys']",
+	},
+	{
+		.name = "write_memory",
+		.mode = COMMAND_EXEC,
+		.jim_handler = jim_write_memory,
+		.help = "write a binary string to target memory",
+		.usage = "address data ['phys']",
+	},
 	{
 		.name = "reset_nag",
 		.handler = handle_target_reset_nag,
@@ -210,6 +210,9 @@ struct target {
 
 	/* The semihosting information, extracted from the target. */
 	struct semihosting *semihosting;
+
+	/* host side copy of halted target memory, NULL unless configured */
+	struct memcache *memcache;
 };
 
 struct target_list {